@@ -0,0 +1,203 @@
+/*
+ * affinity.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Thread pinning from the sysfs topology. The CPUs allowed to the
+ * process are ordered by policy, and thread `id` runs on the CPU of
+ * rank id modulo their number:
+ *
+ *  compact  one thread per core, filling a socket before the next one,
+ *           the SMT siblings once every core is used
+ *  scatter  one thread per core, round robin over the sockets, the SMT
+ *           siblings once every core is used
+ *  smt      the SMT siblings of a core next to each other, so that
+ *           threads n and n + 1 share its caches
+ *
+ * A thread starts with the mask of the thread creating it, so the mask of
+ * the process is saved before any thread is pinned, and a thread with no
+ * policy is given it back.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "affinity.h"
+
+static const char *affinity_names[] = { "none", "compact", "scatter", "smt" };
+
+struct cpu_topo {
+    int cpu;
+    int package;
+    int core;
+    int smt;        /* rank among the hardware threads of the core */
+    int rank;       /* rank of the core in its package */
+};
+
+static struct cpu_topo *topo_order[4];
+static int nb_cpus;
+static cpu_set_t process_set;
+static int process_saved;
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+static int read_topology(int cpu, const char *name)
+{
+    char path[128];
+    FILE *f;
+    int value = 0;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    if ((f = fopen(path, "r")) == NULL)
+        return 0;
+    if (fscanf(f, "%d", &value) != 1)
+        value = 0;
+    fclose(f);
+    return value;
+}
+
+#define CMP_KEY(a, b) do { if ((a) != (b)) return (a) < (b) ? -1 : 1; } while (0)
+
+static int cmp_compact(const void *p1, const void *p2)
+{
+    const struct cpu_topo *a = p1, *b = p2;
+    CMP_KEY(a->smt, b->smt);
+    CMP_KEY(a->package, b->package);
+    CMP_KEY(a->rank, b->rank);
+    return a->cpu - b->cpu;
+}
+
+static int cmp_scatter(const void *p1, const void *p2)
+{
+    const struct cpu_topo *a = p1, *b = p2;
+    CMP_KEY(a->smt, b->smt);
+    CMP_KEY(a->rank, b->rank);
+    CMP_KEY(a->package, b->package);
+    return a->cpu - b->cpu;
+}
+
+static int cmp_smt(const void *p1, const void *p2)
+{
+    const struct cpu_topo *a = p1, *b = p2;
+    CMP_KEY(a->package, b->package);
+    CMP_KEY(a->rank, b->rank);
+    CMP_KEY(a->smt, b->smt);
+    return a->cpu - b->cpu;
+}
+
+/* the mask of the process, before main */
+__attribute__((constructor))
+static void affinity_save(void)
+{
+    process_saved = sched_getaffinity(0, sizeof(process_set), &process_set) == 0;
+}
+
+static void topology_init(void)
+{
+    int (*cmp[4])(const void *, const void *) = { NULL, cmp_compact, cmp_scatter, cmp_smt };
+    struct cpu_topo *cpus;
+    cpu_set_t set = process_set;
+    int cpu, i, j, p;
+
+    if (!process_saved)
+        return;
+    if ((cpus = calloc(CPU_COUNT(&set), sizeof(struct cpu_topo))) == NULL)
+        return;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set))
+            continue;
+        cpus[nb_cpus].cpu = cpu;
+        cpus[nb_cpus].package = read_topology(cpu, "physical_package_id");
+        cpus[nb_cpus].core = read_topology(cpu, "core_id");
+        nb_cpus++;
+    }
+
+    /* the SMT siblings of a core are ranked by CPU id */
+    for (i = 0; i < nb_cpus; i++) {
+        for (j = 0; j < i; j++) {
+            if (cpus[j].package == cpus[i].package && cpus[j].core == cpus[i].core)
+                cpus[i].smt++;
+        }
+    }
+    /* core ids may have holes, the cores of a package are ranked */
+    for (i = 0; i < nb_cpus; i++) {
+        for (j = 0; j < nb_cpus; j++) {
+            if (cpus[j].package == cpus[i].package && cpus[j].smt == 0 &&
+                    cpus[j].core < cpus[i].core)
+                cpus[i].rank++;
+        }
+    }
+
+    for (p = AFFINITY_COMPACT; p <= AFFINITY_SMT; p++) {
+        if ((topo_order[p] = malloc(sizeof(struct cpu_topo) * nb_cpus)) == NULL)
+            continue;
+        memcpy(topo_order[p], cpus, sizeof(struct cpu_topo) * nb_cpus);
+        qsort(topo_order[p], nb_cpus, sizeof(struct cpu_topo), cmp[p]);
+    }
+    free(cpus);
+}
+
+/* policy of the given name, -1 if unknown */
+int affinity_parse(const char *name)
+{
+    int p;
+
+    for (p = AFFINITY_NONE; p <= AFFINITY_SMT; p++) {
+        if (strcmp(name, affinity_names[p]) == 0)
+            return p;
+    }
+    return -1;
+}
+
+const char *affinity_name(int policy)
+{
+    if (policy < AFFINITY_NONE || policy > AFFINITY_SMT)
+        return "unknown";
+    return affinity_names[policy];
+}
+
+/* CPU of thread `id` with the given policy, -1 when not pinned */
+int affinity_cpu(int policy, int id)
+{
+    if (policy <= AFFINITY_NONE || policy > AFFINITY_SMT || id < 0)
+        return -1;
+    pthread_once(&topo_once, topology_init);
+    if (nb_cpus == 0 || topo_order[policy] == NULL)
+        return -1;
+    return topo_order[policy][id % nb_cpus].cpu;
+}
+
+/* give the calling thread the mask of the process back */
+int affinity_reset(void)
+{
+    if (!process_saved)
+        return 0;
+    if (pthread_setaffinity_np(pthread_self(), sizeof(process_set), &process_set) != 0) {
+        printf("affinity error: reset\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * pin the calling thread as thread `id` with the given policy, or give
+ * it the mask of the process back with none
+ */
+int affinity_pin(int policy, int id)
+{
+    cpu_set_t set;
+    int cpu = affinity_cpu(policy, id);
+
+    if (cpu < 0)
+        return affinity_reset();
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        printf("affinity error: thread %d on cpu %d\n", id, cpu);
+        return -1;
+    }
+    return 0;
+}
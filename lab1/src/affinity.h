@@ -0,0 +1,31 @@
+/*
+ * affinity.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef AFFINITY_H_
+#define AFFINITY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum affinity_policy {
+    AFFINITY_NONE = 0,
+    AFFINITY_COMPACT,
+    AFFINITY_SCATTER,
+    AFFINITY_SMT,
+};
+
+int affinity_parse(const char *name);
+const char *affinity_name(int policy);
+int affinity_cpu(int policy, int id);
+int affinity_pin(int policy, int id);
+int affinity_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AFFINITY_H_ */
@@ -12,9 +12,12 @@
 #include <stdlib.h>
 #include <time.h>
 #include <math.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "dragon.h"
 #include "color.h"
+#include "dragon_ctx.h"
 
 const xy_t tiles_orientation[NB_TILES] = {
         {1 ,1},
@@ -62,16 +65,520 @@ xy_t compute_orientation(uint64_t tile, int64_t i)
     return orientation;
 }
 
+/*
+ * Specialized kernels
+ *
+ * The orientation of a move is one of four diagonal directions. It is
+ * kept as a 2-bit direction d, rotate_left being d + 1 and rotate_right
+ * d + 3, so that a turn is an add instead of a swap of the coordinates.
+ * The kernels are generated for each direction at the start of the
+ * walk: r is the rotation relative to it, and the deltas indexed by r
+ * are constants. The draw kernels move a linear index in the canvas,
+ * which removes the multiply of each step.
+ */
+#define DIR_DX(d) (((((d) + 1) & 3) & 2) ? -1 : 1)
+#define DIR_DY(d) ((((d) & 3) & 2) ? -1 : 1)
+/* offset of the cell crossed by a move from its starting position */
+#define CELL_DX(d) (DIR_DX(d) < 0 ? -1 : 0)
+#define CELL_DY(d) (DIR_DY(d) < 0 ? -1 : 0)
+/* rotation after the move of segment n */
+#define TURN(r, n) (((r) + ((((n) & -(n)) << 1) & (n) ? 1 : 3)) & 3)
+
+static int orientation_dir(xy_t orientation)
+{
+    if (orientation.x > 0)
+        return orientation.y > 0 ? 0 : 3;
+    return orientation.y > 0 ? 1 : 2;
+}
+
+#define STORE_RAW(cell, id) dragon[cell] = id
+
+/* keep the highest id, see dragon_draw_atomic */
+#define STORE_ATOMIC(cell, id) do {                                         \
+    char old = __atomic_load_n(&dragon[cell], __ATOMIC_RELAXED);            \
+    while (old < id && !__atomic_compare_exchange_n(&dragon[cell], &old,    \
+                id, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));                \
+} while (0)
+
+/*
+ * keep the first id written, see dragon_draw_tiles_first; the threads
+ * racing on a cell all write the same id
+ */
+#define STORE_FIRST(cell, id) do {                                          \
+    if (__atomic_load_n(&dragon[cell], __ATOMIC_RELAXED) < 0)               \
+        __atomic_store_n(&dragon[cell], id, __ATOMIC_RELAXED);              \
+} while (0)
+
+#define DEFINE_DRAW_KERNEL(name, d0, STORE)                                 \
+static int name##_##d0(uint64_t start, uint64_t end, char *dragon,          \
+        int width, int area, int index, char id)                            \
+{                                                                           \
+    const int move[4] = {                                                   \
+        DIR_DX(d0) + DIR_DY(d0) * width,                                    \
+        DIR_DX(d0 + 1) + DIR_DY(d0 + 1) * width,                            \
+        DIR_DX(d0 + 2) + DIR_DY(d0 + 2) * width,                            \
+        DIR_DX(d0 + 3) + DIR_DY(d0 + 3) * width,                            \
+    };                                                                      \
+    const int cell[4] = {                                                   \
+        CELL_DX(d0) + CELL_DY(d0) * width,                                  \
+        CELL_DX(d0 + 1) + CELL_DY(d0 + 1) * width,                          \
+        CELL_DX(d0 + 2) + CELL_DY(d0 + 2) * width,                          \
+        CELL_DX(d0 + 3) + CELL_DY(d0 + 3) * width,                          \
+    };                                                                      \
+    unsigned r = 0;                                                         \
+    uint64_t n;                                                             \
+    for (n = start + 1; n <= end; n++) {                                    \
+        int c = index + cell[r];                                            \
+        if ((unsigned) c >= (unsigned) area) {                              \
+            printf("index %d is out of range\n", c);                        \
+            return -1;                                                      \
+        }                                                                   \
+        STORE(c, id);                                                       \
+        index += move[r];                                                   \
+        r = TURN(r, n);                                                     \
+    }                                                                       \
+    return 0;                                                               \
+}
+
+typedef int (*draw_kernel)(uint64_t, uint64_t, char *, int, int, int, char);
+
+DEFINE_DRAW_KERNEL(draw_raw, 0, STORE_RAW)
+DEFINE_DRAW_KERNEL(draw_raw, 1, STORE_RAW)
+DEFINE_DRAW_KERNEL(draw_raw, 2, STORE_RAW)
+DEFINE_DRAW_KERNEL(draw_raw, 3, STORE_RAW)
+DEFINE_DRAW_KERNEL(draw_atomic, 0, STORE_ATOMIC)
+DEFINE_DRAW_KERNEL(draw_atomic, 1, STORE_ATOMIC)
+DEFINE_DRAW_KERNEL(draw_atomic, 2, STORE_ATOMIC)
+DEFINE_DRAW_KERNEL(draw_atomic, 3, STORE_ATOMIC)
+
+static const draw_kernel draw_raw_kernels[4] = {
+    draw_raw_0, draw_raw_1, draw_raw_2, draw_raw_3
+};
+static const draw_kernel draw_atomic_kernels[4] = {
+    draw_atomic_0, draw_atomic_1, draw_atomic_2, draw_atomic_3
+};
+
+/*
+ * The four tiles are the same dragon rotated around the origin: tile t
+ * starts with direction TILE_DIR(t), and turns exactly like tile 0. The
+ * fused kernels walk the turns once and move one index per tile.
+ */
+#define TILE_DIR(t) ((t) == 0 ? 0 : (t) == 1 ? 2 : (t) == 2 ? 3 : 1)
+
+#define TILE_MOVES(d0, t, width) {                                          \
+    DIR_DX(d0 + TILE_DIR(t)) + DIR_DY(d0 + TILE_DIR(t)) * width,            \
+    DIR_DX(d0 + TILE_DIR(t) + 1) + DIR_DY(d0 + TILE_DIR(t) + 1) * width,    \
+    DIR_DX(d0 + TILE_DIR(t) + 2) + DIR_DY(d0 + TILE_DIR(t) + 2) * width,    \
+    DIR_DX(d0 + TILE_DIR(t) + 3) + DIR_DY(d0 + TILE_DIR(t) + 3) * width,    \
+}
+#define TILE_CELLS(d0, t, width) {                                          \
+    CELL_DX(d0 + TILE_DIR(t)) + CELL_DY(d0 + TILE_DIR(t)) * width,          \
+    CELL_DX(d0 + TILE_DIR(t) + 1) + CELL_DY(d0 + TILE_DIR(t) + 1) * width,  \
+    CELL_DX(d0 + TILE_DIR(t) + 2) + CELL_DY(d0 + TILE_DIR(t) + 2) * width,  \
+    CELL_DX(d0 + TILE_DIR(t) + 3) + CELL_DY(d0 + TILE_DIR(t) + 3) * width,  \
+}
+
+#define DEFINE_FUSED_KERNEL(name, d0, STORE)                                \
+static int name##_##d0(uint64_t start, uint64_t end, char *dragon,          \
+        int width, int area, int *indexes, char id)                         \
+{                                                                           \
+    const int move[NB_TILES][4] = {                                         \
+        TILE_MOVES(d0, 0, width), TILE_MOVES(d0, 1, width),                 \
+        TILE_MOVES(d0, 2, width), TILE_MOVES(d0, 3, width),                 \
+    };                                                                      \
+    const int cell[NB_TILES][4] = {                                         \
+        TILE_CELLS(d0, 0, width), TILE_CELLS(d0, 1, width),                 \
+        TILE_CELLS(d0, 2, width), TILE_CELLS(d0, 3, width),                 \
+    };                                                                      \
+    int i0 = indexes[0], i1 = indexes[1], i2 = indexes[2], i3 = indexes[3]; \
+    unsigned r = 0;                                                         \
+    uint64_t n;                                                             \
+    for (n = start + 1; n <= end; n++) {                                    \
+        int c0 = i0 + cell[0][r], c1 = i1 + cell[1][r];                     \
+        int c2 = i2 + cell[2][r], c3 = i3 + cell[3][r];                     \
+        if (((unsigned) c0 >= (unsigned) area) |                            \
+            ((unsigned) c1 >= (unsigned) area) |                            \
+            ((unsigned) c2 >= (unsigned) area) |                            \
+            ((unsigned) c3 >= (unsigned) area)) {                           \
+            printf("index is out of range at segment %"PRIu64"\n", n);      \
+            return -1;                                                      \
+        }                                                                   \
+        STORE(c0, id);                                                      \
+        STORE(c1, id);                                                      \
+        STORE(c2, id);                                                      \
+        STORE(c3, id);                                                      \
+        i0 += move[0][r];                                                   \
+        i1 += move[1][r];                                                   \
+        i2 += move[2][r];                                                   \
+        i3 += move[3][r];                                                   \
+        r = TURN(r, n);                                                     \
+    }                                                                       \
+    return 0;                                                               \
+}
+
+typedef int (*fused_kernel)(uint64_t, uint64_t, char *, int, int, int *, char);
+
+DEFINE_FUSED_KERNEL(draw_tiles_raw, 0, STORE_RAW)
+DEFINE_FUSED_KERNEL(draw_tiles_raw, 1, STORE_RAW)
+DEFINE_FUSED_KERNEL(draw_tiles_raw, 2, STORE_RAW)
+DEFINE_FUSED_KERNEL(draw_tiles_raw, 3, STORE_RAW)
+DEFINE_FUSED_KERNEL(draw_tiles_atomic, 0, STORE_ATOMIC)
+DEFINE_FUSED_KERNEL(draw_tiles_atomic, 1, STORE_ATOMIC)
+DEFINE_FUSED_KERNEL(draw_tiles_atomic, 2, STORE_ATOMIC)
+DEFINE_FUSED_KERNEL(draw_tiles_atomic, 3, STORE_ATOMIC)
+DEFINE_FUSED_KERNEL(draw_tiles_first, 0, STORE_FIRST)
+DEFINE_FUSED_KERNEL(draw_tiles_first, 1, STORE_FIRST)
+DEFINE_FUSED_KERNEL(draw_tiles_first, 2, STORE_FIRST)
+DEFINE_FUSED_KERNEL(draw_tiles_first, 3, STORE_FIRST)
+
+static const fused_kernel draw_tiles_raw_kernels[4] = {
+    draw_tiles_raw_0, draw_tiles_raw_1, draw_tiles_raw_2, draw_tiles_raw_3
+};
+static const fused_kernel draw_tiles_atomic_kernels[4] = {
+    draw_tiles_atomic_0, draw_tiles_atomic_1, draw_tiles_atomic_2, draw_tiles_atomic_3
+};
+static const fused_kernel draw_tiles_first_kernels[4] = {
+    draw_tiles_first_0, draw_tiles_first_1, draw_tiles_first_2, draw_tiles_first_3
+};
+
+/*
+ * Positions are relative to the start of the walk and narrowed to 32
+ * bits, the caller makes sure that end - start fits.
+ */
+#define DEFINE_LIMIT_KERNEL(d0)                                             \
+static unsigned limit_kernel_##d0(uint64_t start, uint64_t end,             \
+        int32_t *position, int32_t *box)                                    \
+{                                                                           \
+    const int32_t dx[4] = {                                                 \
+        DIR_DX(d0), DIR_DX(d0 + 1), DIR_DX(d0 + 2), DIR_DX(d0 + 3)          \
+    };                                                                      \
+    const int32_t dy[4] = {                                                 \
+        DIR_DY(d0), DIR_DY(d0 + 1), DIR_DY(d0 + 2), DIR_DY(d0 + 3)          \
+    };                                                                      \
+    int32_t x = 0, y = 0;                                                   \
+    int32_t min_x = box[0], min_y = box[1];                                 \
+    int32_t max_x = box[2], max_y = box[3];                                 \
+    unsigned r = 0;                                                         \
+    uint64_t n;                                                             \
+    for (n = start + 1; n <= end; n++) {                                    \
+        x += dx[r];                                                         \
+        y += dy[r];                                                         \
+        r = TURN(r, n);                                                     \
+        min_x = x < min_x ? x : min_x;                                      \
+        min_y = y < min_y ? y : min_y;                                      \
+        max_x = x > max_x ? x : max_x;                                      \
+        max_y = y > max_y ? y : max_y;                                      \
+    }                                                                       \
+    position[0] = x;                                                        \
+    position[1] = y;                                                        \
+    box[0] = min_x;                                                         \
+    box[1] = min_y;                                                         \
+    box[2] = max_x;                                                         \
+    box[3] = max_y;                                                         \
+    return (d0 + r) & 3;                                                    \
+}
+
+typedef unsigned (*limit_kernel)(uint64_t, uint64_t, int32_t *, int32_t *);
+
+DEFINE_LIMIT_KERNEL(0)
+DEFINE_LIMIT_KERNEL(1)
+DEFINE_LIMIT_KERNEL(2)
+DEFINE_LIMIT_KERNEL(3)
+
+static const limit_kernel limit_kernels[4] = {
+    limit_kernel_0, limit_kernel_1, limit_kernel_2, limit_kernel_3
+};
+
+/*
+ * Block tables
+ *
+ * Within an aligned block of 2^LIMIT_BLOCK_SHIFT segments, the turns
+ * depend on the low bits of n only, except the turn of the middle
+ * segment, which reads bit LIMIT_BLOCK_SHIFT of n, and the turn of the
+ * last segment, which reads higher bits. A block is then described by
+ * its start direction and that parity bit: the table gives the move
+ * over the block, the direction of its last segment and its bounding
+ * box relative to its start. The last turn is done by the caller.
+ * The cells crossed by the block, relative to its start, are kept for
+ * the draws (see draw_blocks).
+ */
+#define LIMIT_BLOCK_SHIFT 8
+#define LIMIT_BLOCK (1 << LIMIT_BLOCK_SHIFT)
+
+struct limit_block {
+    int16_t dx, dy;
+    int16_t min_x, min_y, max_x, max_y;
+    uint8_t dir;
+};
+
+static struct limit_block limit_blocks[4][2];
+static int16_t block_cells[4][2][LIMIT_BLOCK][2];
+static pthread_once_t limit_blocks_once = PTHREAD_ONCE_INIT;
+
+static void limit_blocks_init(void)
+{
+    unsigned d, parity, r;
+    int n, x, y;
+
+    for (d = 0; d < 4; d++) {
+        for (parity = 0; parity < 2; parity++) {
+            struct limit_block *b = &limit_blocks[d][parity];
+            b->min_x = b->min_y = INT16_MAX;
+            b->max_x = b->max_y = INT16_MIN;
+            x = y = 0;
+            r = d;
+            for (n = 1; n <= LIMIT_BLOCK; n++) {
+                block_cells[d][parity][n - 1][0] = x + CELL_DX(r);
+                block_cells[d][parity][n - 1][1] = y + CELL_DY(r);
+                x += DIR_DX(r);
+                y += DIR_DY(r);
+                if (n < LIMIT_BLOCK)
+                    r = TURN(r, (parity << LIMIT_BLOCK_SHIFT) | n);
+                if (x < b->min_x) b->min_x = x;
+                if (y < b->min_y) b->min_y = y;
+                if (x > b->max_x) b->max_x = x;
+                if (y > b->max_y) b->max_y = y;
+            }
+            b->dx = x;
+            b->dy = y;
+            b->dir = r;
+        }
+    }
+}
+
+static int draw_dispatch(const draw_kernel *kernels, uint64_t tile, uint64_t start, uint64_t end,
+        char *dragon, int width, int height, limits_t limits, char id)
+{
+    if (end < start)
+        printf("error: start=%"PRId64" > end=%"PRId64"\n", start, end);
+
+    if (tile >= NB_TILES)
+        printf("error: tile=%"PRId64" not in the range [0,%d[\n", tile, NB_TILES);
+
+    if (end == start)
+        return 0;
+
+    xy_t position = compute_position(tile, start);
+    xy_t orientation = compute_orientation(tile, start);
+    int index = (position.y - limits.minimums.y) * width + (position.x - limits.minimums.x);
+
+    return kernels[orientation_dir(orientation)](start, end, dragon,
+            width, width * height, index, id);
+}
+
+
+static int draw_tiles_dispatch(const fused_kernel *kernels, uint64_t start, uint64_t end,
+        char *dragon, int width, int height, limits_t limits, char id)
+{
+    int indexes[NB_TILES];
+    uint64_t tile;
+    unsigned d0;
+
+    if (end < start)
+        printf("error: start=%"PRId64" > end=%"PRId64"\n", start, end);
+
+    if (end == start)
+        return 0;
+
+    for (tile = 0; tile < NB_TILES; tile++) {
+        xy_t position = compute_position(tile, start);
+        indexes[tile] = (position.y - limits.minimums.y) * width + (position.x - limits.minimums.x);
+    }
+    d0 = orientation_dir(compute_orientation(0, start));
+
+    return kernels[d0](start, end, dragon, width, width * height, indexes, id);
+}
+
+/*
+ * Block stamps
+ *
+ * The cells of the blocks of block_cells as offsets in a canvas of a
+ * given width, with their range, so that a block is checked once and
+ * written without walking its turns.
+ */
+struct draw_stamps {
+    int32_t cells[4][2][LIMIT_BLOCK];
+    int32_t move[4][2];
+    int32_t lo[4][2];
+    int32_t hi[4][2];
+};
+
+static void draw_stamps_init(struct draw_stamps *stamps, int width)
+{
+    unsigned d, parity;
+    int j;
+
+    pthread_once(&limit_blocks_once, limit_blocks_init);
+    for (d = 0; d < 4; d++) {
+        for (parity = 0; parity < 2; parity++) {
+            const struct limit_block *b = &limit_blocks[d][parity];
+            int32_t *cells = stamps->cells[d][parity];
+            int32_t lo = INT32_MAX, hi = INT32_MIN;
+            for (j = 0; j < LIMIT_BLOCK; j++) {
+                cells[j] = block_cells[d][parity][j][0] + block_cells[d][parity][j][1] * width;
+                lo = cells[j] < lo ? cells[j] : lo;
+                hi = cells[j] > hi ? cells[j] : hi;
+            }
+            stamps->move[d][parity] = b->dx + b->dy * width;
+            stamps->lo[d][parity] = lo;
+            stamps->hi[d][parity] = hi;
+        }
+    }
+}
+
+/* below this number of segments, building the stamps costs more than it saves */
+#define DRAW_STAMP_MIN (16 * LIMIT_BLOCK)
+
+#define DEFINE_STAMP(name, STORE)                                           \
+static void name(char *dragon, int index, const int32_t *cells, char id)   \
+{                                                                           \
+    int j;                                                                  \
+    for (j = 0; j < LIMIT_BLOCK; j++)                                       \
+        STORE(index + cells[j], id);                                        \
+}
+
+typedef void (*stamp_kernel)(char *, int, const int32_t *, char);
+
+DEFINE_STAMP(stamp_raw, STORE_RAW)
+DEFINE_STAMP(stamp_atomic, STORE_ATOMIC)
+DEFINE_STAMP(stamp_first, STORE_FIRST)
+
+/*
+ * Draw the aligned blocks between start and end of the given tiles,
+ * both multiples of LIMIT_BLOCK.
+ */
+static int draw_blocks(stamp_kernel stamp, const uint64_t *tiles, int nb_tiles,
+        uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
+{
+    struct draw_stamps stamps;
+    int indexes[NB_TILES];
+    unsigned dirs[NB_TILES];
+    int area = width * height;
+    uint64_t n;
+    int t;
+
+    draw_stamps_init(&stamps, width);
+    for (t = 0; t < nb_tiles; t++) {
+        xy_t position = compute_position(tiles[t], start);
+        indexes[t] = (position.y - limits.minimums.y) * width + (position.x - limits.minimums.x);
+        dirs[t] = orientation_dir(compute_orientation(tiles[t], start));
+    }
+
+    for (n = start; n < end; n += LIMIT_BLOCK) {
+        unsigned parity = (n >> LIMIT_BLOCK_SHIFT) & 1;
+        for (t = 0; t < nb_tiles; t++) {
+            unsigned d = dirs[t];
+            int index = indexes[t];
+            if (index + stamps.lo[d][parity] < 0 || index + stamps.hi[d][parity] >= area) {
+                printf("index is out of range at segment %"PRIu64"\n", n);
+                return -1;
+            }
+            stamp(dragon, index, stamps.cells[d][parity], id);
+            indexes[t] = index + stamps.move[d][parity];
+            dirs[t] = TURN(limit_blocks[d][parity].dir, n + LIMIT_BLOCK);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Segments up to the first aligned block and after the last one are
+ * walked by the kernels, the blocks in between are stamped.
+ */
+static int draw_stamped(const draw_kernel *kernels, stamp_kernel stamp, uint64_t tile,
+        uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
+{
+    uint64_t head, tail;
+
+    if (end < start + DRAW_STAMP_MIN || tile >= NB_TILES)
+        return draw_dispatch(kernels, tile, start, end, dragon, width, height, limits, id);
+
+    head = (start + LIMIT_BLOCK - 1) & ~((uint64_t) LIMIT_BLOCK - 1);
+    tail = end & ~((uint64_t) LIMIT_BLOCK - 1);
+    if (draw_dispatch(kernels, tile, start, head, dragon, width, height, limits, id) < 0 ||
+        draw_blocks(stamp, &tile, 1, head, tail, dragon, width, height, limits, id) < 0)
+        return -1;
+    return draw_dispatch(kernels, tile, tail, end, dragon, width, height, limits, id);
+}
+
+static int draw_tiles_stamped(const fused_kernel *kernels, stamp_kernel stamp,
+        uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
+{
+    static const uint64_t tiles[NB_TILES] = { 0, 1, 2, 3 };
+    uint64_t head, tail;
+
+    if (end < start + DRAW_STAMP_MIN)
+        return draw_tiles_dispatch(kernels, start, end, dragon, width, height, limits, id);
+
+    head = (start + LIMIT_BLOCK - 1) & ~((uint64_t) LIMIT_BLOCK - 1);
+    tail = end & ~((uint64_t) LIMIT_BLOCK - 1);
+    if (draw_tiles_dispatch(kernels, start, head, dragon, width, height, limits, id) < 0 ||
+        draw_blocks(stamp, tiles, NB_TILES, head, tail, dragon, width, height, limits, id) < 0)
+        return -1;
+    return draw_tiles_dispatch(kernels, tail, end, dragon, width, height, limits, id);
+}
+
 /* draw dragon in raw matrix
  *
  * The `tile` parameter controls the initial orientation of the dragon.
  * */
 int dragon_draw_raw(uint64_t tile, uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
+{
+    return draw_stamped(draw_raw_kernels, stamp_raw, tile, start, end, dragon, width, height, limits, id);
+}
+
+/* draw the dragons of all the tiles in raw matrix
+ *
+ * Same as dragon_draw_raw for each tile, but the turns are computed once
+ * for the four tiles.
+ * */
+int dragon_draw_tiles(uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
+{
+    return draw_tiles_stamped(draw_tiles_raw_kernels, stamp_raw, start, end, dragon, width, height, limits, id);
+}
+
+/* same as dragon_draw_tiles, keeping the highest id of each cell */
+int dragon_draw_tiles_atomic(uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
+{
+    return draw_tiles_stamped(draw_tiles_atomic_kernels, stamp_atomic, start, end, dragon, width, height, limits, id);
+}
+
+/*
+ * same as dragon_draw_tiles, only writing the empty cells: a cell keeps
+ * the first id written to it, and the ids written afterwards leave it
+ * unchanged. The dragon can then grow by ranges of segments of
+ * increasing ids while a reader renders the cells up to an id.
+ */
+int dragon_draw_tiles_first(uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
+{
+    return draw_tiles_stamped(draw_tiles_first_kernels, stamp_first, start, end, dragon, width, height, limits, id);
+}
+
+/* draw dragon in raw matrix, keeping the highest id of each cell
+ *
+ * The serial draw paints the colors in increasing order, so the last id
+ * written to a cell is also the highest. Keeping the maximum with an
+ * atomic compare and swap gives the same canvas whatever the order of
+ * the threads. The cell is read first, and most cells need no swap.
+ * */
+int dragon_draw_atomic(uint64_t tile, uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
+{
+    return draw_stamped(draw_atomic_kernels, stamp_atomic, tile, start, end, dragon, width, height, limits, id);
+}
+
+/* draw dragon in a window of the raw matrix
+ *
+ * Same walk as dragon_draw_raw, but `limits.minimums` is the origin of a
+ * `width` x `height` window and cells falling outside of it are skipped.
+ * When two segments cover the same cell, the highest id is kept, which is
+ * what the serial draw produces since colors are drawn in increasing order.
+ * */
+int dragon_draw_clip(uint64_t tile, uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id)
 {
     if (end < start)
         printf("error: start=%"PRId64" > end=%"PRId64"\n", start, end);
 
-    if (tile < 0 || tile >= NB_TILES)
+    if (tile >= NB_TILES)
         printf("error: tile=%"PRId64" not in the range [0,%d[\n", tile, NB_TILES);
 
     if (end == start)
@@ -79,24 +586,21 @@ int dragon_draw_raw(uint64_t tile, uint64_t start, uint64_t end, char *dragon, i
 
     xy_t position;
     xy_t orientation;
-    int i, j;
+    int64_t i, j;
     uint64_t n;
     position = compute_position(tile, start);
     orientation = compute_orientation(tile, start);
 
-    // draw dragon
     position.x -= limits.minimums.x;
     position.y -= limits.minimums.y;
-    int area = width * height;
     for (n = start + 1; n <= end; n++) {
         j = (position.x + (position.x + orientation.x)) >> 1;
         i = (position.y + (position.y + orientation.y)) >> 1;
-        int index = i * width + j;
-        if (index < 0 || index > area) {
-            printf("index %d is out of range\n", i);
-            return -1;
+        if (j >= 0 && j < width && i >= 0 && i < height) {
+            char *cell = &dragon[i * width + j];
+            if (*cell < id)
+                *cell = id;
         }
-        dragon[index] = id;
         position.x += orientation.x;
         position.y += orientation.y;
 
@@ -108,6 +612,152 @@ int dragon_draw_raw(uint64_t tile, uint64_t start, uint64_t end, char *dragon, i
     return 0;
 }
 
+/*
+ * Bounding box of the vertices of block `block` of `tile`, a block being
+ * the segments ]block << shift, (block + 1) << shift] clamped to `size`.
+ * The cells drawn by the block are within [minimums, maximums[.
+ */
+void block_limit(uint64_t tile, uint64_t block, int shift, uint64_t size, limits_t *limits)
+{
+    piece_t piece;
+    uint64_t start = block << shift;
+    uint64_t end = (block + 1) << shift;
+
+    if (end > size)
+        end = size;
+    piece.position = compute_position(tile, start);
+    piece.orientation = compute_orientation(tile, start);
+    piece.limits.minimums = piece.position;
+    piece.limits.maximums = piece.position;
+    piece_limit(start, end, &piece);
+    *limits = piece.limits;
+}
+
+/*
+ * return the color of the segments drawn from vertex n, when `size`
+ * segments are split evenly in `nb_colors` ranges
+ */
+int segment_color(uint64_t n, uint64_t size, int nb_colors)
+{
+    uint64_t m = n * nb_colors / size;
+
+    while (m > 0 && m * size / nb_colors > n)
+        m--;
+    while (m + 1 < (uint64_t) nb_colors && (m + 1) * size / nb_colors <= n)
+        m++;
+    return m;
+}
+
+/*
+ * Draw the rows [first, last[ of the canvas in `band`, from the blocks
+ * of 2^shift segments whose bounding box, given by block_limit for each
+ * tile, crosses these rows.
+ */
+void dragon_draw_band(const limits_t *blocks, uint64_t nb_blocks, int shift, uint64_t size,
+        int nb_colors, char *band, int width, int first, int last, limits_t limits)
+{
+    limits_t origin;
+    uint64_t i;
+
+    origin.minimums.x = limits.minimums.x;
+    origin.minimums.y = limits.minimums.y + first;
+    origin.maximums = origin.minimums;
+    for (i = 0; i < nb_blocks * NB_TILES; i++) {
+        const limits_t *b = &blocks[i];
+        if (b->minimums.y - limits.minimums.y >= last ||
+            b->maximums.y - limits.minimums.y <= first)
+            continue;
+        uint64_t n = (i % nb_blocks) << shift;
+        uint64_t stop = n + (1ULL << shift);
+        if (stop > size)
+            stop = size;
+        while (n < stop) {
+            int m = segment_color(n, size, nb_colors);
+            uint64_t next = (m + 1) * size / nb_colors;
+            if (next > stop)
+                next = stop;
+            dragon_draw_clip(i / nb_blocks, n, next, band, width, last - first, origin, m);
+            n = next;
+        }
+    }
+}
+
+/*
+ * Blocks of about sqrt(size) segments, whose bounding boxes are
+ * computed by band_plan_blocks.
+ */
+int band_plan_init(struct band_plan *plan, char *dragon, limits_t limits, uint64_t size, int nb_colors,
+        struct rgb *image, int image_width, int image_height, struct palette *palette)
+{
+    memset(plan, 0, sizeof(struct band_plan));
+    plan->dragon = dragon;
+    plan->dragon_width = limits.maximums.x - limits.minimums.x;
+    plan->dragon_height = limits.maximums.y - limits.minimums.y;
+    plan->image = image;
+    plan->image_width = image_width;
+    plan->image_height = image_height;
+    plan->palette = palette;
+    plan->limits = limits;
+    plan->size = size;
+    plan->nb_colors = nb_colors;
+    for (plan->shift = 8; (1ULL << (2 * plan->shift)) < size; plan->shift++);
+    plan->nb_blocks = (size + (1ULL << plan->shift) - 1) >> plan->shift;
+    plan->blocks = malloc(sizeof(limits_t) * plan->nb_blocks * NB_TILES);
+    return plan->blocks == NULL ? -1 : 0;
+}
+
+/* bounding boxes of the part `part` of `nb_parts` of the blocks */
+void band_plan_blocks(struct band_plan *plan, int part, int nb_parts)
+{
+    uint64_t total = plan->nb_blocks * NB_TILES;
+    uint64_t i;
+    struct perf_sample sample;
+
+    /* the boxes are counted with the draw they serve */
+    perf_begin(plan->perf, &sample);
+    for (i = part * total / nb_parts; i < (part + 1) * total / nb_parts; i++)
+        block_limit(i / plan->nb_blocks, i % plan->nb_blocks, plan->shift, plan->size, &plan->blocks[i]);
+    perf_end(plan->perf, PERF_DRAW, &sample);
+}
+
+/*
+ * Clear, draw and render the band `band` of `nb_bands` of the image. The
+ * canvas rows of the band are the ones read by its image rows, so they
+ * are only touched by the thread of the band, and the bands cover the
+ * whole canvas. Without image, only the canvas is drawn.
+ */
+void band_plan_draw(struct band_plan *plan, int band, int nb_bands)
+{
+    int start = band * plan->image_height / nb_bands;
+    int end = (band + 1) * plan->image_height / nb_bands;
+    int first, last;
+    char *rows;
+    struct perf_sample sample;
+
+    scale_source_rows(start, end, plan->image_width, plan->image_height,
+            plan->dragon_width, plan->dragon_height, &first, &last);
+    rows = plan->dragon + (size_t) first * plan->dragon_width;
+    perf_begin(plan->perf, &sample);
+    init_canvas(0, (last - first) * plan->dragon_width, rows, -1);
+    perf_end(plan->perf, PERF_CLEAR, &sample);
+    perf_begin(plan->perf, &sample);
+    dragon_draw_band(plan->blocks, plan->nb_blocks, plan->shift, plan->size, plan->nb_colors,
+            rows, plan->dragon_width, first, last, plan->limits);
+    perf_end(plan->perf, PERF_DRAW, &sample);
+    if (plan->image != NULL) {
+        perf_begin(plan->perf, &sample);
+        scale_dragon_band(start, end, plan->image + (size_t) start * plan->image_width,
+                plan->image_width, plan->image_height, plan->dragon, 0,
+                plan->dragon_width, plan->dragon_height, plan->palette);
+        perf_end(plan->perf, PERF_RENDER, &sample);
+    }
+}
+
+void band_plan_free(struct band_plan *plan)
+{
+    FREE(plan->blocks);
+}
+
 void init_canvas(int start, int end, char *canvas, char value)
 {
     int i;
@@ -145,6 +795,37 @@ void dump_canvas_rgb(struct rgb *canvas, int width, int height)
 
 void scale_dragon(int start, int end, struct rgb *image, int image_width, int image_height,
         char *dragon, int dragon_width, int dragon_height, struct palette *palette)
+{
+    scale_dragon_band(start, end, image + start * image_width, image_width, image_height,
+            dragon, 0, dragon_width, dragon_height, palette);
+}
+
+/*
+ * rows [first, last[ of the dragon read to render the image rows [start, end[
+ */
+void scale_source_rows(int start, int end, int image_width, int image_height,
+        int dragon_width, int dragon_height, int *first, int *last)
+{
+    int scale_x = dragon_width / image_width + 1;
+    int scale_y = dragon_height / image_height + 1;
+    int scale = (scale_x > scale_y ? scale_x : scale_y);
+    int deltaI = (scale * image_height - dragon_height) / 2;
+
+    *first = start * scale - deltaI;
+    *last = end * scale - deltaI;
+    if (*first < 0) *first = 0;
+    if (*last > dragon_height) *last = dragon_height;
+    if (*last < *first) *last = *first;
+}
+
+/*
+ * Render from a window of dragon_width x dragon_height cells, whose rows
+ * are `stride` cells apart, the row first_row being at `dragon`. Only one
+ * row every `row_step` is read under each pixel.
+ */
+static void scale_rows(int start, int end, struct rgb *band, int image_width, int image_height,
+        char *dragon, int first_row, int stride, int dragon_width, int dragon_height,
+        struct palette *palette, int row_step)
 {
     int i, j, x, y;
 
@@ -171,9 +852,9 @@ void scale_dragon(int start, int end, struct rgb *image, int image_width, int im
             if (j1 < 0) j1 = 0;
             if (j2 > dragon_width) j2 = dragon_width;
 
-            for (i = i1; i < i2; i++) {
+            for (i = i1; i < i2; i += row_step) {
                 for (j = j1; j < j2; j++) {
-                    int id = dragon[i * dragon_width + j];
+                    int id = dragon[(i - first_row) * stride + j];
                     if (id >= 0) {
                         red     += colors[id].r;
                         green   += colors[id].g;
@@ -186,29 +867,66 @@ void scale_dragon(int start, int end, struct rgb *image, int image_width, int im
                     cnt++;
                 }
             }
-            int index = y * image_width + x;
+            int index = (y - start) * image_width + x;
             if (cnt == 0) {
-                image[index] = white;
+                band[index] = white;
             } else {
-                image[index].r = (unsigned char) (red   / cnt);
-                image[index].g = (unsigned char) (green / cnt);
-                image[index].b = (unsigned char) (blue  / cnt);
+                band[index].r = (unsigned char) (red   / cnt);
+                band[index].g = (unsigned char) (green / cnt);
+                band[index].b = (unsigned char) (blue  / cnt);
             }
         }
     }
 }
 
-int dragon_draw_serial(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_colors)
+/*
+ * Same as scale_dragon, for a band of the image and of the dragon:
+ * `band` holds the image rows [start, end[ and `dragon` holds the rows
+ * of the dragon starting at `first_row`, which must cover the rows
+ * given by scale_source_rows.
+ */
+void scale_dragon_band(int start, int end, struct rgb *band, int image_width, int image_height,
+        char *dragon, int first_row, int dragon_width, int dragon_height, struct palette *palette)
+{
+    scale_rows(start, end, band, image_width, image_height, dragon, first_row,
+            dragon_width, dragon_width, dragon_height, palette, 1);
+}
+
+/*
+ * Render the rows [start, end[ of the image, stored from `image`, from a
+ * window of a larger canvas whose rows are `stride` cells apart.
+ */
+void scale_dragon_window(int start, int end, struct rgb *image, int image_width, int image_height,
+        char *window, int stride, int dragon_width, int dragon_height, struct palette *palette)
+{
+    scale_rows(start, end, image + (size_t) start * image_width, image_width, image_height,
+            window, 0, stride, dragon_width, dragon_height, palette, 1);
+}
+
+/*
+ * Preview of scale_dragon, averaging one canvas row every `row_step`
+ * under each pixel, to read about 1 / row_step of the canvas.
+ */
+void scale_dragon_sampled(int start, int end, struct rgb *image, int image_width, int image_height,
+        char *dragon, int dragon_width, int dragon_height, struct palette *palette, int row_step)
+{
+    scale_rows(start, end, image + (size_t) start * image_width, image_width, image_height,
+            dragon, 0, dragon_width, dragon_width, dragon_height, palette, row_step);
+}
+
+int dragon_draw_serial(struct dragon_ctx *ctx, char **canvas, struct rgb *image, int width, int height, uint64_t size)
 {
     int ret = 0;
     char *dragon = NULL;
-    struct palette *palette = NULL;
+    int nb_colors = ctx->nb_thread;
+    struct dragon_perf *perf = dragon_ctx_perf(ctx);
+    struct perf_sample sample;
     limits_t limits;
     limits.minimums.x = 0;
     limits.minimums.y = 0;
     limits.maximums = limits.minimums;
 
-    if (dragon_limits_serial(&limits, size, 0) < 0)
+    if (dragon_limits_serial(ctx, &limits, size) < 0)
         goto err;
 
     int dragon_width = limits.maximums.x - limits.minimums.x;
@@ -216,46 +934,45 @@ int dragon_draw_serial(char **canvas, struct rgb *image, int width, int height,
     int area = dragon_width * dragon_height;
     int m;
 
-    dragon = (char*)malloc(sizeof(char) * area);
+    // Surface gardée par le contexte d'un appel à l'autre
+    dragon = dragon_ctx_canvas(ctx, area);
     if (dragon == NULL) {
         printf("error: Dragon not allocated\n");
         goto err;
     }
 
-    palette = init_palette(nb_colors);
-    if (palette == NULL) {
-        printf("error: Palette not initialized\n");
-        goto err;
-    }
-
     // Initialiser la surface
+    perf_begin(perf, &sample);
     init_canvas(0, area, dragon, -1);
+    perf_end(perf, PERF_CLEAR, &sample);
 
     // Dessiner les dragons dans les 4 directions
+    perf_begin(perf, &sample);
     for (m = 0; m < nb_colors; m++) {
         uint64_t start = m * size / nb_colors;
         uint64_t end = (m + 1) * size / nb_colors;
 
         /*
-         * Le premier argument (tile) contrôle la direction vers laquelle
-         * le dragon est dessiné.
+         * Les 4 dragons sont dessinés en un seul parcours, chacun
+         * dans la direction de sa tuile.
          */
-        dragon_draw_raw(0, start, end, dragon, dragon_width, dragon_height, limits, m);
-        dragon_draw_raw(1, start, end, dragon, dragon_width, dragon_height, limits, m);
-        dragon_draw_raw(2, start, end, dragon, dragon_width, dragon_height, limits, m);
-        dragon_draw_raw(3, start, end, dragon, dragon_width, dragon_height, limits, m);
+        dragon_draw_tiles(start, end, dragon, dragon_width, dragon_height, limits, m);
     }
+    perf_end(perf, PERF_DRAW, &sample);
 
-    // Rendu final
-    scale_dragon(0, height, image, width, height, dragon, dragon_width, dragon_height, palette);
+    // Rendu final, laissé à l'appelant sans image
+    if (image != NULL) {
+        perf_begin(perf, &sample);
+        scale_dragon(0, height, image, width, height, dragon, dragon_width, dragon_height, ctx->palette);
+        perf_end(perf, PERF_RENDER, &sample);
+    }
 
 done:
-    free_palette(palette);
     *canvas = dragon;
     return ret;
 
 err:
-    FREE(dragon);
+    dragon = NULL;
     ret = -1;
     goto done;
 }
@@ -310,23 +1027,218 @@ int cmp_limits(limits_t *l1, limits_t *l2)
  */
 int cmp_canvas(char *exp, char *act, int width, int height, int verbose)
 {
-    int i, j;
-    int sum = 0;
-    int index;
+    struct canvas_diff diff;
+    int ret;
+
+    if (canvas_diff_init(&diff, 0) < 0)
+        return -1;
+    ret = cmp_canvas_report(exp, act, width, height, 0, verbose, &diff);
+    if (ret == 0)
+        ret = diff.count;
+    canvas_diff_free(&diff);
+    return ret;
+}
+
+int canvas_diff_init(struct canvas_diff *diff, int nb_colors)
+{
+    int nb_ids = nb_colors + 1;
+
+    memset(diff, 0, sizeof(struct canvas_diff));
+    diff->nb_colors = nb_colors;
+    diff->pairs = calloc(nb_ids * nb_ids, sizeof(int64_t));
+    if (diff->pairs == NULL)
+        return -1;
+    return 0;
+}
+
+void canvas_diff_free(struct canvas_diff *diff)
+{
+    FREE(diff->pairs);
+}
+
+void dump_canvas_diff(struct canvas_diff *diff)
+{
+    int e, a;
+    int nb_ids = diff->nb_colors + 1;
+
+    if (diff->count == 0)
+        return;
+    printf("mismatch=%"PRId64"%s box=", diff->count, diff->stopped ? " (early exit)" : "");
+    dump_limits(&diff->box);
+    for (e = 0; e < nb_ids; e++) {
+        for (a = 0; a < nb_ids; a++) {
+            int64_t cnt = diff->pairs[e * nb_ids + a];
+            if (cnt > 0)
+                printf("  expected=%2d actual=%2d count=%"PRId64"\n", e - 1, a - 1, cnt);
+        }
+    }
+}
+
+typedef uint64_t cmp_block_t __attribute__((vector_size(CMP_BLOCK)));
+
+/*
+ * offset of the first block of CMP_BLOCK cells that differs, or of the
+ * tail shorter than a block when all the full blocks are equal. Equal
+ * blocks are the common case, and each one is checked with a couple of
+ * vector instructions.
+ */
+__attribute__((target_clones("avx2", "default")))
+static int64_t cmp_blocks(const char *exp, const char *act, int64_t len)
+{
+    int64_t i;
+
+    for (i = 0; i + CMP_BLOCK <= len; i += CMP_BLOCK) {
+        cmp_block_t a, b, d;
+        uint64_t any = 0;
+        unsigned k;
+        memcpy(&a, exp + i, CMP_BLOCK);
+        memcpy(&b, act + i, CMP_BLOCK);
+        d = a ^ b;
+        for (k = 0; k < CMP_BLOCK / sizeof(uint64_t); k++)
+            any |= d[k];
+        if (any)
+            return i;
+    }
+    return i;
+}
+
+/*
+ * Compare exp and act and accumulate the mismatches in `diff`: count,
+ * bounding box and count per (expected, actual) pair of ids. The
+ * comparison stops early once more than `threshold` cells differ, unless
+ * threshold is 0. With `verbose`, at most CMP_DUMP_MAX cells are printed.
+ */
+int cmp_canvas_report(char *exp, char *act, int width, int height,
+        int64_t threshold, int verbose, struct canvas_diff *diff)
+{
+    int64_t area = (int64_t) width * height;
+    int64_t nb_chunks = (area + CMP_CHUNK - 1) / CMP_CHUNK;
+    int64_t chunk;
+    int nb_ids = diff->nb_colors + 1;
+    int64_t dumped = 0;
+    int stop = 0;
+
     if (exp == NULL || act == NULL)
         return -1;
-    #pragma omp parallel for reduction(+:sum) private(index, j)
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            index = i * width + j;
-            if (exp[index] != act[index]) {
-                if (verbose)
-                    printf("pix error (%5d, %5d) expected=%2d actual=%2d\n", j, i, exp[index], act[index]);
-                sum += 1;
+
+    diff->box.minimums.x = width;
+    diff->box.minimums.y = height;
+    diff->box.maximums.x = -1;
+    diff->box.maximums.y = -1;
+
+    #pragma omp parallel
+    {
+        struct canvas_diff local;
+        int64_t *pairs = calloc(nb_ids * nb_ids, sizeof(int64_t));
+        int k;
+
+        local.count = 0;
+        local.box = diff->box;
+        #pragma omp for schedule(dynamic)
+        for (chunk = 0; chunk < nb_chunks; chunk++) {
+            int64_t begin = chunk * CMP_CHUNK;
+            int64_t end = begin + CMP_CHUNK < area ? begin + CMP_CHUNK : area;
+            int64_t index = begin;
+            int64_t count;
+            int stopped;
+
+            #pragma omp atomic read
+            stopped = stop;
+            if (stopped)
+                continue;
+            while ((index += cmp_blocks(exp + index, act + index, end - index)) < end) {
+                int64_t last = index + CMP_BLOCK < end ? index + CMP_BLOCK : end;
+                for (; index < last; index++) {
+                    int e = exp[index], a = act[index];
+                    int64_t i = index / width, j = index % width;
+                    if (e == a)
+                        continue;
+                    local.count++;
+                    if (local.box.minimums.x > j) local.box.minimums.x = j;
+                    if (local.box.minimums.y > i) local.box.minimums.y = i;
+                    if (local.box.maximums.x < j) local.box.maximums.x = j;
+                    if (local.box.maximums.y < i) local.box.maximums.y = i;
+                    if (pairs != NULL && e >= -1 && e < diff->nb_colors &&
+                            a >= -1 && a < diff->nb_colors)
+                        pairs[(e + 1) * nb_ids + (a + 1)]++;
+                    if (verbose && __sync_fetch_and_add(&dumped, 1) < CMP_DUMP_MAX)
+                        printf("pix error (%5"PRId64", %5"PRId64") expected=%2d actual=%2d\n", j, i, e, a);
+                }
+                if (threshold > 0) {
+                    #pragma omp atomic read
+                    count = diff->count;
+                    if (count + local.count > threshold)
+                        break;
+                }
+            }
+            if (threshold > 0) {
+                #pragma omp atomic capture
+                count = diff->count += local.count;
+                local.count = 0;
+                if (count > threshold) {
+                    #pragma omp atomic write
+                    stop = 1;
+                }
+            }
+        }
+
+        #pragma omp critical
+        {
+            diff->count += local.count;
+            merge_limits(&diff->box, &local.box);
+            if (pairs != NULL) {
+                for (k = 0; k < nb_ids * nb_ids; k++)
+                    diff->pairs[k] += pairs[k];
             }
         }
+        FREE(pairs);
+    }
+
+    if (verbose && dumped > CMP_DUMP_MAX)
+        printf("... %"PRId64" more pix errors\n", dumped - CMP_DUMP_MAX);
+    diff->stopped = stop;
+    return 0;
+}
+
+static uint64_t hash_chunk(const unsigned char *data, size_t len, uint64_t h)
+{
+    const uint64_t prime = 0x9e3779b97f4a7c15ULL;
+    size_t i;
+
+    for (i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(uint64_t));
+        h = (h ^ w) * prime;
+        h ^= h >> 29;
     }
-    return sum;
+    for (; i < len; i++)
+        h = (h ^ data[i]) * prime;
+    return h ^ (h >> 32);
+}
+
+/*
+ * 64-bit content hash, used to compare canvas and images with a
+ * reference without keeping it. Chunks are hashed in parallel and the
+ * result does not depend on the number of threads.
+ */
+uint64_t hash_canvas(const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+    int64_t nb_chunks = (len + HASH_CHUNK - 1) / HASH_CHUNK;
+    uint64_t *hashes;
+    uint64_t h = len;
+    int64_t i;
+
+    if ((hashes = malloc(sizeof(uint64_t) * (nb_chunks + 1))) == NULL)
+        return 0;
+    #pragma omp parallel for
+    for (i = 0; i < nb_chunks; i++) {
+        size_t chunk = (i + 1) * HASH_CHUNK > len ? len - i * HASH_CHUNK : HASH_CHUNK;
+        hashes[i] = hash_chunk(bytes + i * HASH_CHUNK, chunk, i);
+    }
+    h = hash_chunk((unsigned char *) hashes, sizeof(uint64_t) * nb_chunks, h);
+    free(hashes);
+    return h;
 }
 
 void piece_init(piece_t *piece)
@@ -341,7 +1253,45 @@ void piece_init(piece_t *piece)
     piece->limits.maximums = piece->position;
 }
 
-int dragon_limits_serial(limits_t *lim, uint64_t nbIterations, __attribute__((unused)) int nb_thread)
+/*
+ * Merge into `lim` the limits of the four tiles, from the limits
+ * `tile` of tile 0: the other tiles are the same dragon rotated by a
+ * quarter turn, which is what limits_invert does to a box.
+ */
+void merge_tiles_limits(limits_t *lim, limits_t tile)
+{
+    int i;
+
+    for (i = 0; i < NB_TILES; i++) {
+        merge_limits(lim, &tile);
+        limits_invert(&tile);
+    }
+}
+
+int dragon_limits_serial(struct dragon_ctx *ctx, limits_t *lim, uint64_t nbIterations)
+{
+    piece_t piece;
+    struct perf_sample sample;
+
+    /*
+     * Seule la tuile 0 est parcourue, les limites des autres
+     * tuiles en sont déduites par rotation.
+     */
+    piece_init(&piece);
+    piece.orientation = tiles_orientation[0];
+    perf_begin(dragon_ctx_perf(ctx), &sample);
+    piece_limit(0, nbIterations, &piece);
+    perf_end(dragon_ctx_perf(ctx), PERF_LIMITS, &sample);
+
+    merge_tiles_limits(lim, piece.limits);
+    return 0;
+}
+
+/*
+ * Limits computed with a walk per tile, used to check the limits
+ * deduced by rotation.
+ */
+int dragon_limits_tiles(__attribute__((unused)) struct dragon_ctx *ctx, limits_t *lim, uint64_t nbIterations)
 {
     int i;
     piece_t pieces[NB_TILES];
@@ -372,13 +1322,31 @@ struct rgb *make_canvas(int width, int height)
     return (struct rgb *) malloc(sizeof(struct rgb) * area);
 }
 
-void piece_limit(int64_t start, int64_t end, piece_t *m)
+static void piece_walk(int64_t start, int64_t end, piece_t *m)
 {
     int64_t n;
     xy_t *position = &m->position;
     xy_t *orientation = &m->orientation;
     xy_t *minimums = &m->limits.minimums;
     xy_t *maximums = &m->limits.maximums;
+
+    if (end > start && end - start < INT32_MAX) {
+        int32_t delta[2];
+        int32_t box[4] = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+        unsigned d = limit_kernels[orientation_dir(*orientation)](start, end, delta, box);
+        xy_t min = { position->x + box[0], position->y + box[1] };
+        xy_t max = { position->x + box[2], position->y + box[3] };
+        position->x += delta[0];
+        position->y += delta[1];
+        orientation->x = DIR_DX(d);
+        orientation->y = DIR_DY(d);
+        if (minimums->x > min.x) minimums->x = min.x;
+        if (minimums->y > min.y) minimums->y = min.y;
+        if (maximums->x < max.x) maximums->x = max.x;
+        if (maximums->y < max.y) maximums->y = max.y;
+        return;
+    }
+
     for (n = start + 1; n <= end; n++) {
         position->x += orientation->x;
         position->y += orientation->y;
@@ -394,6 +1362,46 @@ void piece_limit(int64_t start, int64_t end, piece_t *m)
     }
 }
 
+void piece_limit(int64_t start, int64_t end, piece_t *m)
+{
+    int64_t n, head;
+    unsigned d;
+    xy_t position, min, max;
+
+    if (end - start < 2 * LIMIT_BLOCK) {
+        piece_walk(start, end, m);
+        return;
+    }
+    pthread_once(&limit_blocks_once, limit_blocks_init);
+
+    /* segments up to the first aligned block */
+    head = (start + LIMIT_BLOCK - 1) & ~((int64_t) LIMIT_BLOCK - 1);
+    piece_walk(start, head, m);
+
+    d = orientation_dir(m->orientation);
+    position = m->position;
+    min = m->limits.minimums;
+    max = m->limits.maximums;
+    for (n = head; n + LIMIT_BLOCK <= end; n += LIMIT_BLOCK) {
+        const struct limit_block *b = &limit_blocks[d][(n >> LIMIT_BLOCK_SHIFT) & 1];
+        if (min.x > position.x + b->min_x) min.x = position.x + b->min_x;
+        if (min.y > position.y + b->min_y) min.y = position.y + b->min_y;
+        if (max.x < position.x + b->max_x) max.x = position.x + b->max_x;
+        if (max.y < position.y + b->max_y) max.y = position.y + b->max_y;
+        position.x += b->dx;
+        position.y += b->dy;
+        d = TURN(b->dir, n + LIMIT_BLOCK);
+    }
+    m->position = position;
+    m->orientation.x = DIR_DX(d);
+    m->orientation.y = DIR_DY(d);
+    m->limits.minimums = min;
+    m->limits.maximums = max;
+
+    /* remaining segments */
+    piece_walk(n, end, m);
+}
+
 /*
  * merge m2 into m1
  * This operation is associative, but not commutative
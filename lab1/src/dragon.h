@@ -14,6 +14,8 @@
 #include <inttypes.h>
 #include "color.h"
 
+struct dragon_perf;
+
 /**
  * TODO:
  *
@@ -52,6 +54,7 @@ struct draw_data {
 	int id;
 	int *tid;
 	int nb_thread;
+	int deterministic;
 	int dragon_width;
 	int dragon_height;
 	int image_width;
@@ -65,6 +68,7 @@ struct draw_data {
 	uint64_t size;
 	limits_t limits;
 	pthread_barrier_t *barrier;
+	struct dragon_perf *perf;	/* NULL without counters */
 //};
 } __attribute__((aligned(128)));
 
@@ -72,13 +76,65 @@ struct limit_data {
 	int id;
 	uint64_t start;
 	uint64_t end;
-	piece_t pieces[NB_TILES];
+	piece_t piece;
+	struct dragon_perf *perf;
 //};
 } __attribute__((aligned(128)));
 
+/* cells compared per vector block, and per parallel chunk */
+#define CMP_BLOCK 64
+#define CMP_CHUNK (1 << 16)
+/* maximum number of mismatching cells printed */
+#define CMP_DUMP_MAX 16
+/* bytes hashed per parallel chunk */
+#define HASH_CHUNK (1 << 20)
+
+struct canvas_diff {
+	int64_t count;
+	int stopped;
+	limits_t box;
+	int nb_colors;
+	int64_t *pairs;
+};
+
+/*
+ * Draw split in bands of the image: each band clears, draws and renders
+ * only its own rows of the canvas, see band_plan_draw.
+ */
+struct band_plan {
+	char *dragon;
+	int dragon_width;
+	int dragon_height;
+	struct rgb *image;
+	int image_width;
+	int image_height;
+	struct palette *palette;
+	limits_t limits;
+	limits_t *blocks;
+	uint64_t nb_blocks;
+	int shift;
+	int nb_colors;
+	uint64_t size;
+	struct dragon_perf *perf;	/* set after band_plan_init to count */
+};
+
+/*
+ * Workers and chunks per worker of the parallel phases, 0 keeps the
+ * defaults of the backends (one worker per color). Set by the tuner.
+ */
+struct dragon_tuning {
+	int limits_workers;
+	int limits_chunks;
+	int draw_workers;
+	int draw_chunks;
+};
+
 extern const xy_t tiles_orientation[NB_TILES];
+struct dragon_ctx;
 
-int dragon_limits_serial(limits_t *limits, uint64_t nbIterations, int nb_thread);
+int dragon_limits_serial(struct dragon_ctx *ctx, limits_t *limits, uint64_t nbIterations);
+int dragon_limits_tiles(struct dragon_ctx *ctx, limits_t *limits, uint64_t nbIterations);
+void merge_tiles_limits(limits_t *lim, limits_t tile);
 void dump_limits(limits_t *limits);
 int cmp_limits(limits_t *l1, limits_t *l2);
 void piece_limit(int64_t debut, int64_t fin, piece_t *m);
@@ -91,15 +147,43 @@ void rotate_right(xy_t *xy);
 void limits_invert(limits_t *limites);
 xy_t compute_position(uint64_t tile, int64_t i);
 xy_t compute_orientation(uint64_t tile, int64_t i);
-int dragon_draw_serial(char **dragon, struct rgb *image, int width, int height, uint64_t size, __attribute__((unused)) int nb_thread);
+int dragon_draw_serial(struct dragon_ctx *ctx, char **dragon, struct rgb *image, int width, int height, uint64_t size);
 void dump_canvas(char *canvas, int width, int height);
 void dump_canvas_rgb(struct rgb *canvas, int width, int height);
 int write_img(struct rgb *image, char *file, int width, int height);
 struct rgb *make_canvas(int width, int height);
 int cmp_canvas(char *exp, char *act, int width, int height, int verbose);
+int cmp_canvas_report(char *exp, char *act, int width, int height,
+        int64_t threshold, int verbose, struct canvas_diff *diff);
+int canvas_diff_init(struct canvas_diff *diff, int nb_colors);
+void canvas_diff_free(struct canvas_diff *diff);
+void dump_canvas_diff(struct canvas_diff *diff);
+uint64_t hash_canvas(const void *data, size_t len);
 void init_canvas(int start, int end, char *canvas, char value);
 void scale_dragon(int start, int end, struct rgb *image, int image_width, int image_height,
         char *dragon, int dragon_width, int dragon_height, struct palette *palette);
+void scale_dragon_band(int start, int end, struct rgb *band, int image_width, int image_height,
+        char *dragon, int first_row, int dragon_width, int dragon_height, struct palette *palette);
+void scale_dragon_window(int start, int end, struct rgb *image, int image_width, int image_height,
+        char *window, int stride, int dragon_width, int dragon_height, struct palette *palette);
+void scale_dragon_sampled(int start, int end, struct rgb *image, int image_width, int image_height,
+        char *dragon, int dragon_width, int dragon_height, struct palette *palette, int row_step);
+void scale_source_rows(int start, int end, int image_width, int image_height,
+        int dragon_width, int dragon_height, int *first, int *last);
 int dragon_draw_raw(uint64_t tile, uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id);
+int dragon_draw_tiles(uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id);
+int dragon_draw_tiles_atomic(uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id);
+int dragon_draw_tiles_first(uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id);
+int dragon_draw_atomic(uint64_t tile, uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id);
+int dragon_draw_clip(uint64_t tile, uint64_t start, uint64_t end, char *dragon, int width, int height, limits_t limits, char id);
+void block_limit(uint64_t tile, uint64_t block, int shift, uint64_t size, limits_t *limits);
+int segment_color(uint64_t n, uint64_t size, int nb_colors);
+void dragon_draw_band(const limits_t *blocks, uint64_t nb_blocks, int shift, uint64_t size,
+        int nb_colors, char *band, int width, int first, int last, limits_t limits);
+int band_plan_init(struct band_plan *plan, char *dragon, limits_t limits, uint64_t size, int nb_colors,
+        struct rgb *image, int image_width, int image_height, struct palette *palette);
+void band_plan_blocks(struct band_plan *plan, int part, int nb_parts);
+void band_plan_draw(struct band_plan *plan, int band, int nb_bands);
+void band_plan_free(struct band_plan *plan);
 
 #endif /* DRAGON_H_ */
@@ -0,0 +1,350 @@
+/*
+ * dragon_animate.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Growth of the dragon from the power `first` to the power `last`, one
+ * frame per power, written as a YUV4MPEG2 (4:4:4) or raw RGB24 video.
+ *
+ * The dragon of 2^k segments is the beginning of the one of 2^(k+1)
+ * segments, so the frames share one canvas, sized for the last power,
+ * and each frame only draws the segments it adds, with the id of its
+ * generation. The cells keep the first id written to them (see
+ * dragon_draw_tiles_first), which makes the ids of a cell only go from
+ * empty to its final generation: frame k is the window of its limits
+ * rendered with the generations after k as empty, whatever the draws
+ * of the next frames did to the canvas in the meantime.
+ *
+ * The main thread draws the generations with an OpenMP team, the render
+ * thread renders the frames drawn in a ring of ANIM_BUFFERS images, and
+ * the writer thread encodes and writes them in order. The draw of frame
+ * k + 1 then overlaps the render and the write of frame k.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "dragon.h"
+#include "color.h"
+#include "dragon_ctx.h"
+#include "dragon_perf.h"
+#include "dragon_animate.h"
+
+/* images rendered ahead of the writer */
+#define ANIM_BUFFERS 3
+#define ANIM_FPS 10
+/* chunks of a generation per thread, for the balance */
+#define ANIM_CHUNKS_PER_THREAD 4
+
+static const char *format_names[] = { "y4m", "rgb" };
+
+struct anim {
+    FILE *file;
+    int format;
+    int width;
+    int height;
+    char *canvas;
+    limits_t limits;        /* of the last frame, the canvas */
+    limits_t *frames;       /* limits of each frame */
+    int nb_frames;
+    int first;
+    struct palette *palette;    /* one color per generation */
+    struct rgb *buffers[ANIM_BUFFERS];
+    unsigned char *planes;  /* encoded frame */
+    struct dragon_perf *perf;
+    int verbose;
+    int nb_drawn;
+    int nb_rendered;
+    int nb_written;
+    int render_done;
+    int closing;
+    int ret;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+int anim_format_parse(const char *name)
+{
+    int f;
+
+    for (f = ANIM_Y4M; f <= ANIM_RGB; f++) {
+        if (strcmp(name, format_names[f]) == 0)
+            return f;
+    }
+    return -1;
+}
+
+const char *anim_format_name(int format)
+{
+    if (format < ANIM_Y4M || format > ANIM_RGB)
+        return "unknown";
+    return format_names[format];
+}
+
+/* render the frames in the ring, as they are drawn */
+static void *anim_render(void *arg)
+{
+    struct anim *anim = arg;
+    struct palette palette;
+    struct rgb colors[anim->nb_frames];
+    struct perf_sample sample;
+    int k, i;
+
+    palette.colors = colors;
+    palette.len = anim->nb_frames;
+    for (k = 0; k < anim->nb_frames; k++) {
+        pthread_mutex_lock(&anim->lock);
+        while (!anim->closing && (anim->nb_drawn <= k || anim->nb_written <= k - ANIM_BUFFERS))
+            pthread_cond_wait(&anim->cond, &anim->lock);
+        if (anim->closing) {
+            pthread_mutex_unlock(&anim->lock);
+            break;
+        }
+        pthread_mutex_unlock(&anim->lock);
+
+        /* the generations after k are not drawn yet in frame k */
+        for (i = 0; i < anim->nb_frames; i++)
+            colors[i] = i <= k ? anim->palette->colors[i] : white;
+        limits_t *f = &anim->frames[k];
+        int stride = anim->limits.maximums.x - anim->limits.minimums.x;
+        char *window = anim->canvas + (f->minimums.y - anim->limits.minimums.y) * stride +
+                (f->minimums.x - anim->limits.minimums.x);
+        perf_begin(anim->perf, &sample);
+        scale_dragon_window(0, anim->height, anim->buffers[k % ANIM_BUFFERS], anim->width,
+                anim->height, window, stride, f->maximums.x - f->minimums.x,
+                f->maximums.y - f->minimums.y, &palette);
+        perf_end(anim->perf, PERF_RENDER, &sample);
+
+        pthread_mutex_lock(&anim->lock);
+        anim->nb_rendered = k + 1;
+        pthread_cond_broadcast(&anim->cond);
+        pthread_mutex_unlock(&anim->lock);
+    }
+    pthread_mutex_lock(&anim->lock);
+    anim->render_done = 1;
+    pthread_cond_broadcast(&anim->cond);
+    pthread_mutex_unlock(&anim->lock);
+    return NULL;
+}
+
+/* full range BT.601 to studio range YCbCr, one plane after the other */
+static void encode_y4m(struct anim *anim, struct rgb *image)
+{
+    size_t n = (size_t) anim->width * anim->height, i;
+    unsigned char *y = anim->planes, *u = y + n, *v = u + n;
+
+    for (i = 0; i < n; i++) {
+        int r = image[i].r, g = image[i].g, b = image[i].b;
+        y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        u[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        v[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+}
+
+/* write the frames in order, as they are rendered */
+static void *anim_writer(void *arg)
+{
+    struct anim *anim = arg;
+    size_t n = (size_t) anim->width * anim->height;
+    int k, ret;
+
+    for (k = 0; k < anim->nb_frames; k++) {
+        pthread_mutex_lock(&anim->lock);
+        while (anim->nb_rendered <= k && !anim->render_done)
+            pthread_cond_wait(&anim->cond, &anim->lock);
+        if (anim->nb_rendered <= k) {
+            pthread_mutex_unlock(&anim->lock);
+            break;
+        }
+        pthread_mutex_unlock(&anim->lock);
+
+        struct rgb *image = anim->buffers[k % ANIM_BUFFERS];
+        if (anim->format == ANIM_Y4M) {
+            encode_y4m(anim, image);
+            ret = fputs("FRAME\n", anim->file) < 0 ||
+                    fwrite(anim->planes, 3, n, anim->file) != n ? -1 : 0;
+        } else {
+            ret = fwrite(image, sizeof(struct rgb), n, anim->file) != n ? -1 : 0;
+        }
+        if (anim->verbose)
+            fprintf(stderr, "animate frame %d power %d written\n", k, anim->first + k);
+
+        pthread_mutex_lock(&anim->lock);
+        if (ret < 0) {
+            fprintf(stderr, "write error frame %d\n", k);
+            anim->ret = -1;
+            anim->closing = 1;
+        }
+        anim->nb_written = k + 1;
+        pthread_cond_broadcast(&anim->cond);
+        pthread_mutex_unlock(&anim->lock);
+        if (ret < 0)
+            break;
+    }
+    return NULL;
+}
+
+/*
+ * Limits of each frame, the walk of a frame going on from the end of
+ * the previous one.
+ */
+static void anim_limits(struct anim *anim)
+{
+    piece_t master, piece;
+    uint64_t start = 0, end;
+    int k;
+
+    piece_init(&master);
+    master.orientation = tiles_orientation[0];
+    for (k = 0; k < anim->nb_frames; k++) {
+        end = 1ULL << (anim->first + k);
+        piece_init(&piece);
+        piece.orientation = tiles_orientation[0];
+        piece_limit(start, end, &piece);
+        piece_merge(&master, piece, tiles_orientation[0]);
+        memset(&anim->frames[k], 0, sizeof(limits_t));
+        merge_tiles_limits(&anim->frames[k], master.limits);
+        start = end;
+    }
+    anim->limits = anim->frames[anim->nb_frames - 1];
+}
+
+/* add the segments [start, end[ of the generation id with the team */
+static int anim_draw(struct anim *anim, uint64_t start, uint64_t end, int id, int nb_thread)
+{
+    int width = anim->limits.maximums.x - anim->limits.minimums.x;
+    int height = anim->limits.maximums.y - anim->limits.minimums.y;
+    int nb_chunks = nb_thread * ANIM_CHUNKS_PER_THREAD;
+    int i, err = 0;
+
+    #pragma omp parallel for num_threads(nb_thread) schedule(dynamic) reduction(|:err)
+    for (i = 0; i < nb_chunks; i++) {
+        struct perf_sample sample;
+        uint64_t s = start + (end - start) * i / nb_chunks;
+        uint64_t e = start + (end - start) * (i + 1) / nb_chunks;
+        perf_begin(anim->perf, &sample);
+        err |= dragon_draw_tiles_first(s, e, anim->canvas, width, height, anim->limits, id) < 0;
+        perf_end(anim->perf, PERF_DRAW, &sample);
+    }
+    return err ? -1 : 0;
+}
+
+/*
+ * Write the frames of the powers first to last of the dragon to `path`,
+ * "-" being the standard output, at width x height.
+ */
+int dragon_animate(struct dragon_ctx *ctx, const char *path, int format, int width, int height,
+        int first, int last, int verbose)
+{
+    struct anim anim;
+    pthread_t render, writer;
+    struct perf_sample sample;
+    int started = 0, k, i, ret = 0;
+    size_t area;
+
+    memset(&anim, 0, sizeof(struct anim));
+    anim.format = format;
+    anim.width = width;
+    anim.height = height;
+    anim.first = first;
+    anim.nb_frames = last - first + 1;
+    anim.perf = dragon_ctx_perf(ctx);
+    anim.verbose = verbose;
+    pthread_mutex_init(&anim.lock, NULL);
+    pthread_cond_init(&anim.cond, NULL);
+
+    if ((anim.frames = malloc(sizeof(limits_t) * anim.nb_frames)) == NULL ||
+        (anim.palette = init_palette(anim.nb_frames)) == NULL ||
+        (anim.planes = malloc((size_t) 3 * width * height)) == NULL) {
+        fprintf(stderr, "malloc error animate\n");
+        goto err;
+    }
+    for (i = 0; i < ANIM_BUFFERS; i++) {
+        if ((anim.buffers[i] = malloc(sizeof(struct rgb) * width * height)) == NULL) {
+            fprintf(stderr, "malloc error animate\n");
+            goto err;
+        }
+    }
+
+    perf_begin(anim.perf, &sample);
+    anim_limits(&anim);
+    perf_end(anim.perf, PERF_LIMITS, &sample);
+    area = (size_t) (anim.limits.maximums.x - anim.limits.minimums.x) *
+            (anim.limits.maximums.y - anim.limits.minimums.y);
+    if ((anim.canvas = dragon_ctx_canvas(ctx, area)) == NULL)
+        goto err;
+    perf_begin(anim.perf, &sample);
+    init_canvas(0, area, anim.canvas, -1);
+    perf_end(anim.perf, PERF_CLEAR, &sample);
+
+    if (strcmp(path, "-") == 0) {
+        anim.file = stdout;
+    } else if ((anim.file = fopen(path, "w")) == NULL) {
+        perror(path);
+        goto err;
+    }
+    if (format == ANIM_Y4M &&
+        fprintf(anim.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, ANIM_FPS) < 0)
+        goto err;
+
+    if (pthread_create(&render, NULL, anim_render, &anim) != 0) {
+        fprintf(stderr, "pthread create error\n");
+        goto err;
+    }
+    if (pthread_create(&writer, NULL, anim_writer, &anim) != 0) {
+        fprintf(stderr, "pthread create error\n");
+        pthread_mutex_lock(&anim.lock);
+        anim.closing = 1;
+        pthread_cond_broadcast(&anim.cond);
+        pthread_mutex_unlock(&anim.lock);
+        pthread_join(render, NULL);
+        goto err;
+    }
+    started = 1;
+
+    for (k = 0; k < anim.nb_frames; k++) {
+        uint64_t start = k == 0 ? 0 : 1ULL << (first + k - 1);
+        if (anim_draw(&anim, start, 1ULL << (first + k), k, ctx->nb_thread) < 0)
+            goto err;
+        pthread_mutex_lock(&anim.lock);
+        anim.nb_drawn = k + 1;
+        pthread_cond_broadcast(&anim.cond);
+        if (anim.closing)
+            k = anim.nb_frames;
+        pthread_mutex_unlock(&anim.lock);
+    }
+
+done:
+    if (started) {
+        pthread_join(render, NULL);
+        pthread_join(writer, NULL);
+    }
+    if (anim.ret < 0)
+        ret = -1;
+    if (anim.file != NULL && anim.file != stdout && fclose(anim.file) != 0)
+        ret = -1;
+    if (anim.file == stdout && fflush(stdout) != 0)
+        ret = -1;
+    for (i = 0; i < ANIM_BUFFERS; i++)
+        FREE(anim.buffers[i]);
+    if (anim.palette != NULL)
+        free_palette(anim.palette);
+    FREE(anim.planes);
+    FREE(anim.frames);
+    pthread_mutex_destroy(&anim.lock);
+    pthread_cond_destroy(&anim.cond);
+    return ret;
+err:
+    ret = -1;
+    pthread_mutex_lock(&anim.lock);
+    anim.closing = 1;
+    pthread_cond_broadcast(&anim.cond);
+    pthread_mutex_unlock(&anim.lock);
+    goto done;
+}
@@ -0,0 +1,23 @@
+/*
+ * dragon_animate.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_ANIMATE_H_
+#define DRAGON_ANIMATE_H_
+
+#include "dragon.h"
+#include "dragon_ctx.h"
+
+enum anim_format {
+    ANIM_Y4M,
+    ANIM_RGB,
+};
+
+int anim_format_parse(const char *name);
+const char *anim_format_name(int format);
+int dragon_animate(struct dragon_ctx *ctx, const char *path, int format, int width, int height,
+        int first, int last, int verbose);
+
+#endif /* DRAGON_ANIMATE_H_ */
@@ -0,0 +1,274 @@
+/*
+ * dragon_batch.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Many dragons drawn by one process. The jobs file holds one job per
+ * line, blank lines and lines starting with '#' being skipped:
+ *
+ *   <size> <width> <height> <output>
+ *
+ * The draws run on one OpenMP team of nb_thread threads, kept from job
+ * to job, with the palette of the context. The jobs go through
+ * BATCH_SLOTS slots whose canvas and image only grow: the main thread
+ * draws a job in a free slot while the writer thread renders and writes
+ * the job drawn before it, so that the draw of job N + 1 overlaps the
+ * render and write of job N.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "dragon.h"
+#include "color.h"
+#include "affinity.h"
+#include "dragon_ctx.h"
+#include "dragon_batch.h"
+
+/* one slot drawn while the other one is written */
+#define BATCH_SLOTS 2
+/* bands of the draw per thread, for the balance */
+#define BATCH_BANDS_PER_THREAD 4
+
+enum slot_state {
+    SLOT_FREE = 0,
+    SLOT_DRAWN,
+};
+
+struct batch_slot {
+    enum slot_state state;
+    struct batch_job *job;
+    limits_t limits;
+    char *dragon;
+    size_t dragon_size;
+    struct rgb *image;
+    size_t image_size;
+};
+
+struct batch {
+    struct batch_slot slots[BATCH_SLOTS];
+    struct batch_job *jobs;
+    int nb_jobs;
+    struct palette *palette;
+    int verbose;
+    int closing;            /* no more job will be drawn */
+    int ret;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/*
+ * return 0 and the jobs of the file at `path`, -1 on a read or syntax
+ * error
+ */
+int batch_load(const char *path, struct batch_job **jobs, int *nb_jobs)
+{
+    FILE *f;
+    char *line = NULL;
+    size_t len = 0;
+    struct batch_job job;
+    struct batch_job *list = NULL;
+    int nb = 0, lineno = 0, ret = 0;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (getline(&line, &len, f) > 0) {
+        char *p = line + strspn(line, " \t");
+        lineno++;
+        if (*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+        memset(&job, 0, sizeof(struct batch_job));
+        if (sscanf(p, "%"SCNu64" %d %d %ms", &job.size, &job.width, &job.height, &job.path) != 4 ||
+            job.size == 0 || job.width <= 0 || job.height <= 0) {
+            printf("%s:%d: expected <size> <width> <height> <output>\n", path, lineno);
+            FREE(job.path);
+            goto err;
+        }
+        struct batch_job *tmp = realloc(list, sizeof(struct batch_job) * (nb + 1));
+        if (tmp == NULL) {
+            FREE(job.path);
+            goto err;
+        }
+        list = tmp;
+        list[nb++] = job;
+    }
+    *jobs = list;
+    *nb_jobs = nb;
+done:
+    FREE(line);
+    fclose(f);
+    return ret;
+err:
+    batch_free(list, nb);
+    ret = -1;
+    goto done;
+}
+
+void batch_free(struct batch_job *jobs, int nb_jobs)
+{
+    int i;
+
+    for (i = 0; jobs != NULL && i < nb_jobs; i++)
+        FREE(jobs[i].path);
+    FREE(jobs);
+}
+
+/* render and write the jobs in order, as their slots are drawn */
+static void *batch_writer(void *arg)
+{
+    struct batch *batch = arg;
+    struct batch_slot *slot;
+    int i;
+
+    for (i = 0; i < batch->nb_jobs; i++) {
+        slot = &batch->slots[i % BATCH_SLOTS];
+        pthread_mutex_lock(&batch->lock);
+        while (slot->state != SLOT_DRAWN && !batch->closing)
+            pthread_cond_wait(&batch->cond, &batch->lock);
+        if (slot->state != SLOT_DRAWN) {
+            pthread_mutex_unlock(&batch->lock);
+            break;
+        }
+        pthread_mutex_unlock(&batch->lock);
+
+        struct batch_job *job = slot->job;
+        scale_dragon(0, job->height, slot->image, job->width, job->height, slot->dragon,
+                slot->limits.maximums.x - slot->limits.minimums.x,
+                slot->limits.maximums.y - slot->limits.minimums.y, batch->palette);
+        int ret = write_img(slot->image, job->path, job->width, job->height);
+        if (batch->verbose)
+            printf("batch job %d written to %s\n", i, job->path);
+
+        pthread_mutex_lock(&batch->lock);
+        if (ret < 0)
+            batch->ret = -1;
+        slot->state = SLOT_FREE;
+        pthread_cond_broadcast(&batch->cond);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return NULL;
+}
+
+/* draw the canvas of the slot with the team, without image */
+static int batch_draw(struct batch_slot *slot, int nb_thread)
+{
+    struct batch_job *job = slot->job;
+    struct band_plan plan;
+    int nb_bands = nb_thread * BATCH_BANDS_PER_THREAD;
+    int i;
+
+    if (band_plan_init(&plan, slot->dragon, slot->limits, job->size, nb_thread,
+            NULL, job->width, job->height, NULL) < 0)
+        return -1;
+    #pragma omp parallel num_threads(nb_thread) private(i)
+    {
+        #pragma omp for schedule(static)
+        for (i = 0; i < nb_bands; i++)
+            band_plan_blocks(&plan, i, nb_bands);
+        #pragma omp for schedule(dynamic)
+        for (i = 0; i < nb_bands; i++)
+            band_plan_draw(&plan, i, nb_bands);
+    }
+    band_plan_free(&plan);
+    return 0;
+}
+
+/*
+ * Draw the jobs with the colors and affinity of the context, each image
+ * being the one of `--cmd draw` for the same size and resolution.
+ */
+int dragon_batch(struct dragon_ctx *ctx, struct batch_job *jobs, int nb_jobs, int verbose)
+{
+    struct batch batch;
+    struct batch_slot *slot;
+    pthread_t writer;
+    int nb_thread = ctx->nb_thread;
+    int i, started = 0, ret = 0;
+
+    memset(&batch, 0, sizeof(struct batch));
+    batch.jobs = jobs;
+    batch.nb_jobs = nb_jobs;
+    batch.verbose = verbose;
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.cond, NULL);
+
+    batch.palette = ctx->palette;
+    /* before the pinning, which the writer would inherit from thread 0 */
+    if (pthread_create(&writer, NULL, batch_writer, &batch) != 0) {
+        printf("pthread create error\n");
+        goto err;
+    }
+    started = 1;
+    if (ctx->affinity != AFFINITY_NONE) {
+        #pragma omp parallel num_threads(nb_thread)
+        {
+#ifdef _OPENMP
+            affinity_pin(ctx->affinity, omp_get_thread_num());
+#else
+            affinity_pin(ctx->affinity, 0);
+#endif
+        }
+    }
+
+    for (i = 0; i < nb_jobs; i++) {
+        slot = &batch.slots[i % BATCH_SLOTS];
+        pthread_mutex_lock(&batch.lock);
+        while (slot->state != SLOT_FREE)
+            pthread_cond_wait(&batch.cond, &batch.lock);
+        pthread_mutex_unlock(&batch.lock);
+
+        slot->job = &jobs[i];
+        memset(&slot->limits, 0, sizeof(limits_t));
+        if (dragon_limits_serial(ctx, &slot->limits, jobs[i].size) < 0)
+            goto err;
+        size_t area = (size_t) (slot->limits.maximums.x - slot->limits.minimums.x) *
+                (slot->limits.maximums.y - slot->limits.minimums.y);
+        if (dragon_buf_grow(ctx, (void **) &slot->dragon, &slot->dragon_size, area) < 0 ||
+            dragon_buf_grow(ctx, (void **) &slot->image, &slot->image_size,
+                    sizeof(struct rgb) * jobs[i].width * jobs[i].height) < 0)
+            goto err;
+        if (verbose)
+            printf("batch job %d size=%"PRIu64" %dx%d\n", i, jobs[i].size,
+                    jobs[i].width, jobs[i].height);
+        if (batch_draw(slot, nb_thread) < 0)
+            goto err;
+
+        pthread_mutex_lock(&batch.lock);
+        slot->state = SLOT_DRAWN;
+        pthread_cond_broadcast(&batch.cond);
+        pthread_mutex_unlock(&batch.lock);
+    }
+
+done:
+    pthread_mutex_lock(&batch.lock);
+    batch.closing = 1;
+    pthread_cond_broadcast(&batch.cond);
+    pthread_mutex_unlock(&batch.lock);
+    if (started)
+        pthread_join(writer, NULL);
+    if (ctx->affinity != AFFINITY_NONE) {
+        #pragma omp parallel num_threads(nb_thread)
+        affinity_reset();
+    }
+    if (batch.ret < 0)
+        ret = -1;
+    for (i = 0; i < BATCH_SLOTS; i++) {
+        FREE(batch.slots[i].dragon);
+        FREE(batch.slots[i].image);
+    }
+    pthread_mutex_destroy(&batch.lock);
+    pthread_cond_destroy(&batch.cond);
+    return ret;
+err:
+    ret = -1;
+    goto done;
+}
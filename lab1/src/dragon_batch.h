@@ -0,0 +1,24 @@
+/*
+ * dragon_batch.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_BATCH_H_
+#define DRAGON_BATCH_H_
+
+#include "dragon.h"
+#include "dragon_ctx.h"
+
+struct batch_job {
+    uint64_t size;
+    int width;
+    int height;
+    char *path;
+};
+
+int batch_load(const char *path, struct batch_job **jobs, int *nb_jobs);
+void batch_free(struct batch_job *jobs, int nb_jobs);
+int dragon_batch(struct dragon_ctx *ctx, struct batch_job *jobs, int nb_jobs, int verbose);
+
+#endif /* DRAGON_BATCH_H_ */
@@ -0,0 +1,523 @@
+/*
+ * dragon_bench.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Microbenchmarks of the primitives of dragon.c, and of the queries of
+ * dragon_index.c, built and run by `make bench`. Each benchmark runs its
+ * primitive over a range of parameters, and reports the time per call
+ * and the bytes of the buffers the call streams over, from which a
+ * bandwidth follows. A run doubles its number of calls until it lasts
+ * --min-time, then the best of BENCH_REPEAT runs is kept, the least
+ * disturbed one.
+ *
+ * The results can be saved as JSON, one benchmark per line, and compared
+ * to such a baseline: a benchmark slower than the baseline by more than
+ * the threshold fails the run.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "dragon.h"
+#include "color.h"
+#include "dragon_index.h"
+
+#define BENCH_REPEAT 5
+#define BENCH_MAX_PARAMS 4
+#define BENCH_NAME_LEN 64
+#define DEFAULT_MIN_TIME 0.05
+#define DEFAULT_THRESHOLD 10.0
+/* side of the rectangles of the index queries */
+#define BENCH_RECT 16
+/* image of the render benchmark */
+#define BENCH_IMAGE_WIDTH 1024
+#define BENCH_IMAGE_HEIGHT 768
+
+struct bench_state {
+    uint64_t param;
+    double bytes;               /* bytes streamed per call */
+    limits_t limits;
+    int width;                  /* canvas */
+    int height;
+    char *canvas;
+    struct rgb *image;
+    struct palette *palette;
+    piece_t pieces[2];
+    struct dragon_index index;
+};
+
+struct bench_def {
+    const char *name;
+    uint64_t params[BENCH_MAX_PARAMS];  /* 0 ends the list */
+    int (*setup)(struct bench_state *s);
+    uint64_t (*run)(struct bench_state *s, uint64_t calls);
+};
+
+struct bench_result {
+    char name[BENCH_NAME_LEN];
+    double ns_per_op;
+    double bytes_per_op;
+};
+
+struct bench_opts {
+    char *filter;
+    char *baseline;
+    char *save;
+    double min_time;
+    double threshold;           /* percent */
+};
+
+/* keeps the results of the primitives alive */
+static volatile uint64_t sink;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* indexes of the upper half of [0, param[, where the walks are longest */
+static uint64_t run_position(struct bench_state *s, uint64_t calls)
+{
+    uint64_t half = s->param / 2, k, acc = 0;
+
+    for (k = 0; k < calls; k++) {
+        xy_t p = compute_position(k % NB_TILES, half + (k & (half - 1)));
+        acc += p.x ^ p.y;
+    }
+    return acc;
+}
+
+static uint64_t run_orientation(struct bench_state *s, uint64_t calls)
+{
+    uint64_t half = s->param / 2, k, acc = 0;
+
+    for (k = 0; k < calls; k++) {
+        xy_t o = compute_orientation(k % NB_TILES, half + (k & (half - 1)));
+        acc += o.x ^ o.y;
+    }
+    return acc;
+}
+
+static uint64_t run_piece_limit(struct bench_state *s, uint64_t calls)
+{
+    piece_t piece;
+    uint64_t k, acc = 0;
+
+    for (k = 0; k < calls; k++) {
+        piece_init(&piece);
+        piece.orientation = tiles_orientation[0];
+        piece_limit(0, s->param, &piece);
+        acc += piece.limits.maximums.x;
+    }
+    return acc;
+}
+
+static int setup_piece_merge(struct bench_state *s)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        piece_init(&s->pieces[i]);
+        s->pieces[i].orientation = tiles_orientation[0];
+        piece_limit(i * s->param / 2, (i + 1) * s->param / 2, &s->pieces[i]);
+    }
+    return 0;
+}
+
+static uint64_t run_piece_merge(struct bench_state *s, uint64_t calls)
+{
+    piece_t piece;
+    uint64_t k, acc = 0;
+
+    for (k = 0; k < calls; k++) {
+        piece = s->pieces[0];
+        piece_merge(&piece, s->pieces[1], tiles_orientation[0]);
+        acc += piece.limits.maximums.x;
+    }
+    return acc;
+}
+
+/* canvas of the dragon of param segments, cleared */
+static int setup_canvas(struct bench_state *s)
+{
+    memset(&s->limits, 0, sizeof(limits_t));
+    dragon_limits_serial(NULL, &s->limits, s->param);
+    s->width = s->limits.maximums.x - s->limits.minimums.x;
+    s->height = s->limits.maximums.y - s->limits.minimums.y;
+    if ((s->canvas = malloc((size_t) s->width * s->height)) == NULL) {
+        printf("malloc error canvas\n");
+        return -1;
+    }
+    init_canvas(0, s->width * s->height, s->canvas, -1);
+    return 0;
+}
+
+/* one cell written per segment */
+static int setup_draw_raw(struct bench_state *s)
+{
+    s->bytes = s->param;
+    return setup_canvas(s);
+}
+
+static uint64_t run_draw_raw(struct bench_state *s, uint64_t calls)
+{
+    uint64_t k, acc = 0;
+
+    for (k = 0; k < calls; k++)
+        acc += dragon_draw_raw(k % NB_TILES, 0, s->param, s->canvas, s->width, s->height,
+                s->limits, k % 8);
+    return acc + s->canvas[0];
+}
+
+/* param bytes cleared */
+static int setup_init_canvas(struct bench_state *s)
+{
+    s->bytes = s->param;
+    if ((s->canvas = malloc(s->param)) == NULL) {
+        printf("malloc error canvas\n");
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t run_init_canvas(struct bench_state *s, uint64_t calls)
+{
+    uint64_t k;
+
+    for (k = 0; k < calls; k++)
+        init_canvas(0, s->param, s->canvas, k & 1 ? -1 : 0);
+    return s->canvas[s->param - 1];
+}
+
+/* the canvas of the dragon of param segments read, the image written */
+static int setup_scale(struct bench_state *s)
+{
+    if (setup_canvas(s) < 0)
+        return -1;
+    dragon_draw_tiles(0, s->param, s->canvas, s->width, s->height, s->limits, 0);
+    s->image = malloc(sizeof(struct rgb) * BENCH_IMAGE_WIDTH * BENCH_IMAGE_HEIGHT);
+    s->palette = init_palette(1);
+    if (s->image == NULL || s->palette == NULL) {
+        printf("malloc error image\n");
+        return -1;
+    }
+    s->bytes = (double) s->width * s->height +
+            sizeof(struct rgb) * BENCH_IMAGE_WIDTH * BENCH_IMAGE_HEIGHT;
+    return 0;
+}
+
+static uint64_t run_scale(struct bench_state *s, uint64_t calls)
+{
+    uint64_t k;
+
+    for (k = 0; k < calls; k++)
+        scale_dragon(0, BENCH_IMAGE_HEIGHT, s->image, BENCH_IMAGE_WIDTH, BENCH_IMAGE_HEIGHT,
+                s->canvas, s->width, s->height, s->palette);
+    return s->image[0].r;
+}
+
+static uint64_t run_index_build(struct bench_state *s, uint64_t calls)
+{
+    uint64_t k, acc = 0;
+
+    for (k = 0; k < calls; k++) {
+        if (dragon_index_build(&s->index, s->param, 0) < 0)
+            return acc;
+        acc += s->index.nb_nodes;
+        dragon_index_free(&s->index);
+    }
+    return acc;
+}
+
+/* index of the dragon of param segments, queried within its limits */
+static int setup_index(struct bench_state *s)
+{
+    memset(&s->limits, 0, sizeof(limits_t));
+    dragon_limits_serial(NULL, &s->limits, s->param);
+    s->width = s->limits.maximums.x - s->limits.minimums.x;
+    s->height = s->limits.maximums.y - s->limits.minimums.y;
+    return dragon_index_build(&s->index, s->param, 0);
+}
+
+/* cell k of a pseudo random sequence within the limits */
+static void bench_cell(struct bench_state *s, uint64_t k, int64_t *x, int64_t *y)
+{
+    uint64_t h = (k + 1) * 0x9e3779b97f4a7c15ULL;
+
+    *x = s->limits.minimums.x + (int64_t) ((h >> 32) % s->width);
+    *y = s->limits.minimums.y + (int64_t) ((h & 0xffffffff) % s->height);
+}
+
+static uint64_t run_index_point(struct bench_state *s, uint64_t calls)
+{
+    uint64_t k, acc = 0;
+    int64_t x, y;
+
+    for (k = 0; k < calls; k++) {
+        bench_cell(s, k, &x, &y);
+        acc += dragon_index_point(&s->index, x, y, NULL, NULL);
+    }
+    return acc;
+}
+
+static uint64_t run_index_rect(struct bench_state *s, uint64_t calls)
+{
+    uint64_t k, acc = 0;
+    limits_t rect;
+
+    for (k = 0; k < calls; k++) {
+        bench_cell(s, k, &rect.minimums.x, &rect.minimums.y);
+        rect.maximums.x = rect.minimums.x + BENCH_RECT;
+        rect.maximums.y = rect.minimums.y + BENCH_RECT;
+        acc += dragon_index_rect(&s->index, rect, NULL, NULL);
+    }
+    return acc;
+}
+
+static const struct bench_def benches[] = {
+    { "compute_position", { 1 << 10, 1 << 20, 1 << 29 }, NULL, run_position },
+    { "compute_orientation", { 1 << 10, 1 << 20, 1 << 29 }, NULL, run_orientation },
+    { "piece_limit", { 1 << 10, 1 << 16, 1 << 20 }, NULL, run_piece_limit },
+    { "piece_merge", { 1 << 20 }, setup_piece_merge, run_piece_merge },
+    { "dragon_draw_raw", { 1 << 12, 1 << 16, 1 << 20 }, setup_draw_raw, run_draw_raw },
+    { "init_canvas", { 1 << 12, 1 << 18, 1 << 24 }, setup_init_canvas, run_init_canvas },
+    { "scale_dragon", { 1 << 16, 1 << 20, 1 << 24 }, setup_scale, run_scale },
+    { "dragon_index_build", { 1 << 16, 1 << 20, 1 << 24 }, NULL, run_index_build },
+    { "dragon_index_point", { 1 << 16, 1 << 20, 1 << 24 }, setup_index, run_index_point },
+    { "dragon_index_rect", { 1 << 16, 1 << 20, 1 << 24 }, setup_index, run_index_rect },
+    { NULL, { 0 }, NULL, NULL },
+};
+
+static void state_free(struct bench_state *s)
+{
+    FREE(s->canvas);
+    FREE(s->image);
+    dragon_index_free(&s->index);
+    if (s->palette != NULL)
+        free_palette(s->palette);
+    s->palette = NULL;
+}
+
+/* ns per call of the least disturbed run lasting at least min_time */
+static double measure(const struct bench_def *def, struct bench_state *s, double min_time)
+{
+    uint64_t calls = 1;
+    double t, best = 0;
+    int i;
+
+    for (;;) {
+        t = now();
+        sink += def->run(s, calls);
+        t = now() - t;
+        if (t >= min_time)
+            break;
+        calls *= 2;
+    }
+    best = t;
+    for (i = 1; i < BENCH_REPEAT; i++) {
+        t = now();
+        sink += def->run(s, calls);
+        t = now() - t;
+        if (t < best)
+            best = t;
+    }
+    return best * 1e9 / calls;
+}
+
+/* results of the baseline file, -1 if it cannot be read */
+static int baseline_load(const char *path, struct bench_result **results, int *nb_results)
+{
+    FILE *f;
+    char *line = NULL;
+    size_t len = 0;
+    struct bench_result *list = NULL, *tmp;
+    int nb = 0, ret = 0;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (getline(&line, &len, f) > 0) {
+        struct bench_result r;
+        char *p = strstr(line, "\"name\"");
+        char *q = strstr(line, "\"ns_per_op\"");
+
+        if (p == NULL || q == NULL ||
+            sscanf(p, "\"name\" : \"%63[^\"]\"", r.name) != 1 ||
+            sscanf(q, "\"ns_per_op\" : %lf", &r.ns_per_op) != 1)
+            continue;
+        r.bytes_per_op = 0;
+        if ((tmp = realloc(list, sizeof(struct bench_result) * (nb + 1))) == NULL) {
+            FREE(list);
+            nb = 0;
+            ret = -1;
+            break;
+        }
+        list = tmp;
+        list[nb++] = r;
+    }
+    FREE(line);
+    fclose(f);
+    *results = list;
+    *nb_results = nb;
+    return ret;
+}
+
+static int results_save(const char *path, struct bench_result *results, int nb_results)
+{
+    FILE *f;
+    int i, ret = 0;
+
+    if ((f = fopen(path, "w")) == NULL) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (i = 0; i < nb_results; i++)
+        fprintf(f, "    { \"name\": \"%s\", \"ns_per_op\": %.3f, \"bytes_per_op\": %.0f }%s\n",
+                results[i].name, results[i].ns_per_op, results[i].bytes_per_op,
+                i + 1 < nb_results ? "," : "");
+    fprintf(f, "  ]\n}\n");
+    if (ferror(f))
+        ret = -1;
+    if (fclose(f) != 0)
+        ret = -1;
+    return ret;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: dragon_bench [OPTIONS]\n");
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, "  --help      this help\n");
+    fprintf(stderr, "  --filter    run the benchmarks whose name contains this string\n");
+    fprintf(stderr, "  --min-time  seconds of a run, %.2f by default\n", DEFAULT_MIN_TIME);
+    fprintf(stderr, "  --save      write the results as JSON to this path\n");
+    fprintf(stderr, "  --baseline  compare to the results of this JSON file\n");
+    fprintf(stderr, "  --threshold slowdown over the baseline that fails, in percent, "
+            "%.0f by default\n", DEFAULT_THRESHOLD);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+static int parse_opts(int argc, char **argv, struct bench_opts *opts)
+{
+    int idx;
+    int opt;
+    struct option options[] = {
+            { "help",      0, 0, 'h' },
+            { "filter",    1, 0, 'f' },
+            { "min-time",  1, 0, 'm' },
+            { "save",      1, 0, 's' },
+            { "baseline",  1, 0, 'b' },
+            { "threshold", 1, 0, 't' },
+            { 0, 0, 0, 0 }
+    };
+
+    memset(opts, 0, sizeof(struct bench_opts));
+    opts->min_time = DEFAULT_MIN_TIME;
+    opts->threshold = DEFAULT_THRESHOLD;
+    while ((opt = getopt_long(argc, argv, "hf:m:s:b:t:", options, &idx)) != -1) {
+        switch (opt) {
+        case 'f':
+            opts->filter = optarg;
+            break;
+        case 'm':
+            opts->min_time = atof(optarg);
+            break;
+        case 's':
+            opts->save = optarg;
+            break;
+        case 'b':
+            opts->baseline = optarg;
+            break;
+        case 't':
+            opts->threshold = atof(optarg);
+            break;
+        case 'h':
+        default:
+            usage();
+            break;
+        }
+    }
+    if (opts->min_time <= 0 || opts->threshold < 0) {
+        printf("Error: min-time must be positive and threshold not negative\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_opts opts;
+    struct bench_result *results = NULL, *base = NULL, *tmp;
+    int nb_results = 0, nb_base = 0, regressions = 0;
+    const struct bench_def *def;
+    int i, j, ret = EXIT_SUCCESS;
+
+    if (parse_opts(argc, argv, &opts) < 0)
+        usage();
+    if (opts.baseline != NULL && baseline_load(opts.baseline, &base, &nb_base) < 0)
+        return EXIT_FAILURE;
+
+    printf("%-32s %12s %12s %10s %10s\n", "benchmark", "ns/op", "bytes/op", "GB/s", "baseline");
+    for (def = benches; def->name != NULL; def++) {
+        if (opts.filter != NULL && strstr(def->name, opts.filter) == NULL)
+            continue;
+        for (i = 0; i < BENCH_MAX_PARAMS && def->params[i] != 0; i++) {
+            struct bench_state s;
+            struct bench_result r;
+
+            memset(&s, 0, sizeof(struct bench_state));
+            s.param = def->params[i];
+            if (def->setup != NULL && def->setup(&s) < 0) {
+                state_free(&s);
+                ret = EXIT_FAILURE;
+                goto done;
+            }
+            snprintf(r.name, BENCH_NAME_LEN, "%s/%"PRIu64, def->name, s.param);
+            r.ns_per_op = measure(def, &s, opts.min_time);
+            r.bytes_per_op = s.bytes;
+            state_free(&s);
+
+            printf("%-32s %12.1f %12.0f %10.2f", r.name, r.ns_per_op, r.bytes_per_op,
+                    r.bytes_per_op / r.ns_per_op);
+            for (j = 0; j < nb_base && strcmp(base[j].name, r.name) != 0; j++);
+            if (j < nb_base && base[j].ns_per_op > 0) {
+                double change = (r.ns_per_op / base[j].ns_per_op - 1) * 100;
+                int slower = change > opts.threshold;
+                printf(" %+9.1f%%%s", change, slower ? " REGRESSION" : "");
+                regressions += slower;
+            }
+            printf("\n");
+
+            if ((tmp = realloc(results, sizeof(struct bench_result) * (nb_results + 1))) == NULL) {
+                ret = EXIT_FAILURE;
+                goto done;
+            }
+            results = tmp;
+            results[nb_results++] = r;
+        }
+    }
+
+    if (opts.save != NULL && results_save(opts.save, results, nb_results) < 0)
+        ret = EXIT_FAILURE;
+    if (regressions > 0) {
+        printf("%d benchmarks slower than %s by more than %.1f%%\n", regressions,
+                opts.baseline, opts.threshold);
+        ret = EXIT_FAILURE;
+    }
+done:
+    FREE(results);
+    FREE(base);
+    return ret;
+}
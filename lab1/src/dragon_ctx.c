@@ -0,0 +1,297 @@
+/*
+ * dragon_ctx.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Reentrant state of the renders. A context keeps its palette, its
+ * canvas and image buffers, which only grow, and its workers from call
+ * to call, so that repeated draws neither allocate nor start threads
+ * once the largest size has been seen.
+ *
+ * The pool runs `worker` on `nb_worker` of its threads, each one given
+ * its slot of `data`, and returns once all of them are done, like a
+ * pthread_create and pthread_join of the workers. Its threads are made
+ * on demand and stay parked on a condition between the runs.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "dragon.h"
+#include "color.h"
+#include "affinity.h"
+#include "dragon_ctx.h"
+
+struct pool_thread {
+    struct dragon_pool *pool;
+    pthread_t thread;
+    int id;
+    int pinned;             /* policy the thread is pinned with, -1 before its first run */
+    uint64_t seen;          /* last run seen */
+};
+
+struct dragon_pool {
+    struct dragon_ctx *ctx;
+    struct pool_thread **threads;
+    int nb_threads;
+    void *(*worker)(void *);
+    char *data;
+    size_t stride;
+    int nb_worker;          /* threads of the current run */
+    int pending;            /* workers of the run not done yet */
+    uint64_t run;           /* number of the current run */
+    int closing;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+};
+
+static void *pool_main(void *arg)
+{
+    struct pool_thread *self = arg;
+    struct dragon_pool *pool = self->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->run == self->seen && !pool->closing)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->closing)
+            break;
+        self->seen = pool->run;
+        if (self->id >= pool->nb_worker)
+            continue;
+        void *(*worker)(void *) = pool->worker;
+        void *data = pool->data + pool->stride * self->id;
+        int policy = pool->ctx->affinity;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (self->pinned != policy && affinity_pin(policy, self->id) == 0)
+            self->pinned = policy;
+        worker(data);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static struct dragon_pool *pool_create(struct dragon_ctx *ctx)
+{
+    struct dragon_pool *pool;
+
+    if ((pool = calloc(1, sizeof(struct dragon_pool))) == NULL)
+        return NULL;
+    pool->ctx = ctx;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    return pool;
+}
+
+/* start threads up to nb_threads, lock held */
+static int pool_grow(struct dragon_pool *pool, int nb_threads)
+{
+    struct pool_thread **tmp;
+    struct pool_thread *t;
+
+    if (nb_threads <= pool->nb_threads)
+        return 0;
+    tmp = realloc(pool->threads, sizeof(struct pool_thread *) * nb_threads);
+    if (tmp == NULL)
+        return -1;
+    pool->threads = tmp;
+    while (pool->nb_threads < nb_threads) {
+        if ((t = calloc(1, sizeof(struct pool_thread))) == NULL)
+            return -1;
+        t->pool = pool;
+        t->id = pool->nb_threads;
+        t->pinned = -1;
+        t->seen = pool->run;
+        if (pthread_create(&t->thread, NULL, pool_main, t) != 0) {
+            printf("pthread create error\n");
+            free(t);
+            return -1;
+        }
+        pool->threads[pool->nb_threads++] = t;
+        pool->ctx->stats.nb_allocs++;
+    }
+    return 0;
+}
+
+static void pool_destroy(struct dragon_pool *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->closing = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->nb_threads; i++) {
+        pthread_join(pool->threads[i]->thread, NULL);
+        free(pool->threads[i]);
+    }
+    FREE(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool);
+}
+
+/*
+ * Run worker(data + i * stride) for i in [0, nb_worker[ on the threads
+ * of the context, and wait for them. The workers all run at the same
+ * time, so that they can share a barrier.
+ */
+int dragon_pool_run(struct dragon_ctx *ctx, int nb_worker, void *(*worker)(void *),
+        void *data, size_t stride)
+{
+    struct dragon_pool *pool;
+    int ret = 0;
+
+    if (nb_worker <= 0)
+        return 0;
+    if (ctx->pool == NULL && (ctx->pool = pool_create(ctx)) == NULL)
+        return -1;
+    pool = ctx->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool_grow(pool, nb_worker) < 0) {
+        ret = -1;
+        goto done;
+    }
+    pool->worker = worker;
+    pool->data = data;
+    pool->stride = stride;
+    pool->nb_worker = nb_worker;
+    pool->pending = nb_worker;
+    pool->run++;
+    pthread_cond_broadcast(&pool->start);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+done:
+    pthread_mutex_unlock(&pool->lock);
+    return ret;
+}
+
+/* context drawing with nb_thread colors, the other settings cleared */
+struct dragon_ctx *dragon_ctx_create(int nb_thread)
+{
+    struct dragon_ctx *ctx;
+
+    if ((ctx = calloc(1, sizeof(struct dragon_ctx))) == NULL)
+        return NULL;
+    ctx->nb_thread = nb_thread;
+    ctx->affinity = AFFINITY_NONE;
+    if ((ctx->palette = init_palette(nb_thread)) == NULL) {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void dragon_ctx_destroy(struct dragon_ctx *ctx)
+{
+    if (ctx == NULL)
+        return;
+    pool_destroy(ctx->pool);
+    if (ctx->tbb != NULL && ctx->tbb_free != NULL)
+        ctx->tbb_free(ctx->tbb);
+    free_palette(ctx->palette);
+    FREE(ctx->canvas);
+    FREE(ctx->image);
+    free(ctx);
+}
+
+/*
+ * make `*buf` of `*cur` bytes at least `size` bytes long, its content is
+ * lost on growth, counted in the stats of the context
+ */
+int dragon_buf_grow(struct dragon_ctx *ctx, void **buf, size_t *cur, size_t size)
+{
+    void *tmp;
+
+    if (size <= *cur)
+        return 0;
+    FREE(*buf);
+    *cur = 0;
+    if ((tmp = malloc(size)) == NULL) {
+        fprintf(stderr, "malloc error: %zu bytes\n", size);
+        return -1;
+    }
+    *buf = tmp;
+    *cur = size;
+    ctx->stats.nb_allocs++;
+    return 0;
+}
+
+/* canvas of at least `area` cells, NULL if it cannot grow */
+char *dragon_ctx_canvas(struct dragon_ctx *ctx, size_t area)
+{
+    if (dragon_buf_grow(ctx, (void **) &ctx->canvas, &ctx->canvas_size, area) < 0)
+        return NULL;
+    return ctx->canvas;
+}
+
+/* image of at least width x height pixels, NULL if it cannot grow */
+struct rgb *dragon_ctx_image(struct dragon_ctx *ctx, int width, int height)
+{
+    size_t size = sizeof(struct rgb) * (size_t) width * height;
+
+    if (dragon_buf_grow(ctx, (void **) &ctx->image, &ctx->image_size, size) < 0)
+        return NULL;
+    return ctx->image;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* draw with a backend, counted in the stats of the context */
+int dragon_ctx_draw(struct dragon_ctx *ctx, dragon_draw_fn draw, char **canvas,
+        struct rgb *image, int width, int height, uint64_t size)
+{
+    double t = now();
+    int ret = draw(ctx, canvas, image, width, height, size);
+
+    t = now() - t;
+    ctx->stats.nb_draws++;
+    ctx->stats.draw_last = t;
+    ctx->stats.draw_total += t;
+    if (t > ctx->stats.draw_max)
+        ctx->stats.draw_max = t;
+    return ret;
+}
+
+int dragon_ctx_limits(struct dragon_ctx *ctx, dragon_limits_fn limits, limits_t *lim,
+        uint64_t size)
+{
+    ctx->stats.nb_limits++;
+    return limits(ctx, lim, size);
+}
+
+void dragon_ctx_dump_stats(struct dragon_ctx *ctx)
+{
+    struct dragon_stats *s = &ctx->stats;
+
+    printf("draws=%"PRIu64" limits=%"PRIu64" allocs=%"PRIu64" draw last=%.6f max=%.6f mean=%.6f s\n",
+            s->nb_draws, s->nb_limits, s->nb_allocs, s->draw_last, s->draw_max,
+            s->nb_draws > 0 ? s->draw_total / s->nb_draws : 0.0);
+}
+
+/* counters given to the phases, NULL when they are not counted */
+struct dragon_perf *dragon_ctx_perf(struct dragon_ctx *ctx)
+{
+    return ctx != NULL && ctx->perf.enabled ? &ctx->perf : NULL;
+}
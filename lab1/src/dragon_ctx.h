@@ -0,0 +1,76 @@
+/*
+ * dragon_ctx.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_CTX_H_
+#define DRAGON_CTX_H_
+
+#include <stddef.h>
+#include <pthread.h>
+#include "dragon.h"
+#include "color.h"
+#include "dragon_perf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct dragon_stats {
+	uint64_t nb_draws;
+	uint64_t nb_limits;
+	uint64_t nb_allocs;     /* buffers grown */
+	double draw_last;       /* seconds */
+	double draw_max;
+	double draw_total;
+};
+
+struct dragon_pool;
+
+/*
+ * State of the renders of one user: settings, buffers and workers. The
+ * canvas and image only grow, and the returned canvas stays owned by
+ * the context until its next draw. Contexts share nothing, so that
+ * several of them can draw at the same time; one context draws once
+ * at a time.
+ */
+struct dragon_ctx {
+	int nb_thread;          /* colors of the draws */
+	int deterministic;      /* parallel draws bit identical to serial */
+	int affinity;           /* enum affinity_policy */
+	struct dragon_tuning tuning;
+	struct palette *palette;
+	char *canvas;
+	size_t canvas_size;
+	struct rgb *image;
+	size_t image_size;
+	struct dragon_pool *pool;   /* pthread workers, made on first use */
+	void *tbb;                  /* TBB arenas, freed with tbb_free */
+	void (*tbb_free)(void *);
+	struct dragon_stats stats;
+	struct dragon_perf perf;    /* phases counted if perf.enabled */
+};
+
+typedef int (*dragon_draw_fn)(struct dragon_ctx *, char **, struct rgb *, int, int, uint64_t);
+typedef int (*dragon_limits_fn)(struct dragon_ctx *, limits_t *, uint64_t);
+
+struct dragon_ctx *dragon_ctx_create(int nb_thread);
+void dragon_ctx_destroy(struct dragon_ctx *ctx);
+char *dragon_ctx_canvas(struct dragon_ctx *ctx, size_t area);
+struct rgb *dragon_ctx_image(struct dragon_ctx *ctx, int width, int height);
+int dragon_buf_grow(struct dragon_ctx *ctx, void **buf, size_t *cur, size_t size);
+int dragon_ctx_draw(struct dragon_ctx *ctx, dragon_draw_fn draw, char **canvas,
+        struct rgb *image, int width, int height, uint64_t size);
+int dragon_ctx_limits(struct dragon_ctx *ctx, dragon_limits_fn limits, limits_t *lim,
+        uint64_t size);
+void dragon_ctx_dump_stats(struct dragon_ctx *ctx);
+struct dragon_perf *dragon_ctx_perf(struct dragon_ctx *ctx);
+int dragon_pool_run(struct dragon_ctx *ctx, int nb_worker, void *(*worker)(void *),
+        void *data, size_t stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRAGON_CTX_H_ */
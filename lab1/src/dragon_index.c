@@ -0,0 +1,218 @@
+/*
+ * dragon_index.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Point and rectangle queries on the cells of the segments, without a
+ * canvas. The segments of each tile are split in blocks of 2^shift
+ * segments whose bounding boxes are the leaves of a binary tree, a node
+ * holding the union of the boxes of its children. The boxes are those of
+ * block_limit, from a single piece_limit walk carried along the tile.
+ *
+ * A query walks down the nodes whose box crosses the rectangle and walks
+ * the segments of the leaves reached, as dragon_draw_clip does. A block
+ * of the dragon is about as wide as high and its neighbors overlap it
+ * little, so a point is in a few boxes per level, and a query costs the
+ * depth of the tree and a few blocks more than the segments it finds.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "dragon.h"
+#include "dragon_index.h"
+
+/*
+ * smallest leaf, of two blocks of limit_blocks so that piece_limit does
+ * not walk its segments, and most leaves per tile before they grow
+ */
+#define INDEX_LEAF_SHIFT 9
+#define INDEX_MAX_LEAVES (1 << 16)
+/* nodes pending in a walk, two per level at most */
+#define INDEX_STACK 128
+
+static inline int box_crosses(const limits_t *box, const limits_t *rect)
+{
+    return box->minimums.x < rect->maximums.x && box->maximums.x > rect->minimums.x &&
+           box->minimums.y < rect->maximums.y && box->maximums.y > rect->minimums.y;
+}
+
+/*
+ * Index the `size` segments of the four tiles, by blocks of 2^shift
+ * segments, or of a size keeping the tree small with shift 0.
+ */
+int dragon_index_build(struct dragon_index *index, uint64_t size, int shift)
+{
+    uint64_t nb, i, tile;
+    piece_t piece;
+    int l;
+
+    memset(index, 0, sizeof(struct dragon_index));
+    if (size == 0) {
+        printf("error: empty dragon index\n");
+        return -1;
+    }
+    if (shift <= 0)
+        for (shift = INDEX_LEAF_SHIFT; (size >> shift) > INDEX_MAX_LEAVES; shift++);
+    index->size = size;
+    index->shift = shift;
+
+    nb = ((size - 1) >> shift) + 1;
+    index->nb_nodes = nb;
+    while (nb > 1) {
+        nb = (nb + 1) / 2;
+        index->nb_nodes += nb;
+        index->nb_levels++;
+    }
+    if (index->nb_levels >= INDEX_STACK / 2) {
+        printf("error: dragon index too deep\n");
+        return -1;
+    }
+    index->level = malloc(sizeof(uint64_t) * (index->nb_levels + 2));
+    if (index->level == NULL)
+        goto err;
+    index->level[0] = 0;
+    nb = ((size - 1) >> shift) + 1;
+    for (l = 0; l <= index->nb_levels; l++) {
+        index->level[l + 1] = index->level[l] + nb;
+        nb = (nb + 1) / 2;
+    }
+
+    for (tile = 0; tile < NB_TILES; tile++) {
+        limits_t *boxes = malloc(sizeof(limits_t) * index->nb_nodes);
+        if (boxes == NULL)
+            goto err;
+        index->boxes[tile] = boxes;
+        piece.position = compute_position(tile, 0);
+        piece.orientation = compute_orientation(tile, 0);
+        for (i = 0; i < index->level[1]; i++) {
+            uint64_t end = (i + 1) << shift;
+            piece.limits.minimums = piece.position;
+            piece.limits.maximums = piece.position;
+            piece_limit(i << shift, end < size ? end : size, &piece);
+            boxes[i] = piece.limits;
+        }
+        for (l = 1; l <= index->nb_levels; l++) {
+            const limits_t *child = boxes + index->level[l - 1];
+            uint64_t nb_child = index->level[l] - index->level[l - 1];
+            for (i = 0; i < index->level[l + 1] - index->level[l]; i++) {
+                limits_t *box = &boxes[index->level[l] + i];
+                *box = child[2 * i];
+                if (2 * i + 1 < nb_child) {
+                    const limits_t *right = &child[2 * i + 1];
+                    if (right->minimums.x < box->minimums.x) box->minimums.x = right->minimums.x;
+                    if (right->minimums.y < box->minimums.y) box->minimums.y = right->minimums.y;
+                    if (right->maximums.x > box->maximums.x) box->maximums.x = right->maximums.x;
+                    if (right->maximums.y > box->maximums.y) box->maximums.y = right->maximums.y;
+                }
+            }
+        }
+    }
+    return 0;
+
+err:
+    printf("malloc error dragon index\n");
+    dragon_index_free(index);
+    return -1;
+}
+
+void dragon_index_free(struct dragon_index *index)
+{
+    int tile;
+
+    for (tile = 0; tile < NB_TILES; tile++)
+        FREE(index->boxes[tile]);
+    FREE(index->level);
+}
+
+/* count the segments of the leaf whose cell is in rect, -1 when stopped */
+static int scan_leaf(const struct dragon_index *index, uint64_t tile, uint64_t leaf,
+        const limits_t *rect, dragon_index_fn found, void *data, int64_t *count)
+{
+    uint64_t start = leaf << index->shift;
+    uint64_t end = start + (1ULL << index->shift);
+    xy_t position, orientation;
+    uint64_t n;
+
+    if (end > index->size)
+        end = index->size;
+    position = compute_position(tile, start);
+    orientation = compute_orientation(tile, start);
+    for (n = start + 1; n <= end; n++) {
+        int64_t j = (position.x + (position.x + orientation.x)) >> 1;
+        int64_t i = (position.y + (position.y + orientation.y)) >> 1;
+        if (j >= rect->minimums.x && j < rect->maximums.x &&
+            i >= rect->minimums.y && i < rect->maximums.y) {
+            (*count)++;
+            if (found != NULL && found(tile, n - 1, data))
+                return -1;
+        }
+        position.x += orientation.x;
+        position.y += orientation.y;
+
+        if (((n & -n) << 1) & n)
+            rotate_left(&orientation);
+        else
+            rotate_right(&orientation);
+    }
+    return 0;
+}
+
+/*
+ * Segments of the four tiles drawing a cell of rect, the cells [minimums,
+ * maximums[ in the coordinates of the dragon, given in increasing order
+ * for each tile to `found` when not NULL. Returns the number of segments
+ * found, up to the one stopping the query.
+ */
+int64_t dragon_index_rect(const struct dragon_index *index, limits_t rect,
+        dragon_index_fn found, void *data)
+{
+    struct { int level; uint64_t node; } stack[INDEX_STACK];
+    int64_t count = 0;
+    uint64_t tile;
+
+    for (tile = 0; tile < NB_TILES; tile++) {
+        const limits_t *boxes = index->boxes[tile];
+        int top = 0;
+
+        stack[top].level = index->nb_levels;
+        stack[top].node = 0;
+        top++;
+        while (top > 0) {
+            top--;
+            int level = stack[top].level;
+            uint64_t node = stack[top].node;
+            if (!box_crosses(&boxes[index->level[level] + node], &rect))
+                continue;
+            if (level == 0) {
+                if (scan_leaf(index, tile, node, &rect, found, data, &count) < 0)
+                    return count;
+                continue;
+            }
+            /* the right child is pushed first, for the segments to come in order */
+            if (2 * node + 1 < index->level[level] - index->level[level - 1]) {
+                stack[top].level = level - 1;
+                stack[top].node = 2 * node + 1;
+                top++;
+            }
+            stack[top].level = level - 1;
+            stack[top].node = 2 * node;
+            top++;
+        }
+    }
+    return count;
+}
+
+int64_t dragon_index_point(const struct dragon_index *index, int64_t x, int64_t y,
+        dragon_index_fn found, void *data)
+{
+    limits_t rect;
+
+    rect.minimums.x = x;
+    rect.minimums.y = y;
+    rect.maximums.x = x + 1;
+    rect.maximums.y = y + 1;
+    return dragon_index_rect(index, rect, found, data);
+}
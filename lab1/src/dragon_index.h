@@ -0,0 +1,35 @@
+/*
+ * dragon_index.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_INDEX_H_
+#define DRAGON_INDEX_H_
+
+#include "dragon.h"
+
+/*
+ * Tree of the bounding boxes of the blocks of 2^shift segments of each
+ * tile, the leaves first, then each level above, up to the root.
+ */
+struct dragon_index {
+    uint64_t size;
+    int shift;
+    int nb_levels;
+    uint64_t *level;            /* first node of each level, nb_levels + 1 */
+    uint64_t nb_nodes;
+    limits_t *boxes[NB_TILES];
+};
+
+/* called for each segment found, a non zero return stops the query */
+typedef int (*dragon_index_fn)(uint64_t tile, uint64_t segment, void *data);
+
+int dragon_index_build(struct dragon_index *index, uint64_t size, int shift);
+void dragon_index_free(struct dragon_index *index);
+int64_t dragon_index_rect(const struct dragon_index *index, limits_t rect,
+        dragon_index_fn found, void *data);
+int64_t dragon_index_point(const struct dragon_index *index, int64_t x, int64_t y,
+        dragon_index_fn found, void *data);
+
+#endif /* DRAGON_INDEX_H_ */
@@ -0,0 +1,236 @@
+/*
+ * dragon_mpi.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Distributed dragon: each rank computes the limits of a part of the
+ * segments, then draws and renders a horizontal band of the image. Only
+ * the rendered rows are sent to rank 0, the full canvas never exists.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "dragon.h"
+#include "color.h"
+#include "dragon_ctx.h"
+#include "dragon_mpi.h"
+
+static void mpi_finalize(void)
+{
+    int finalized;
+
+    MPI_Finalized(&finalized);
+    if (!finalized)
+        MPI_Finalize();
+}
+
+/*
+ * MPI is initialized on first use, so that dragonizer runs with or
+ * without mpirun
+ */
+static void mpi_init(int *rank, int *nb_rank)
+{
+    int initialized;
+
+    MPI_Initialized(&initialized);
+    if (!initialized) {
+        MPI_Init(NULL, NULL);
+        atexit(mpi_finalize);
+    }
+    MPI_Comm_rank(MPI_COMM_WORLD, rank);
+    MPI_Comm_size(MPI_COMM_WORLD, nb_rank);
+}
+
+/*
+ * 1 when `ok` on all the ranks. A rank failing before a collective call
+ * goes through this first, so that none is left waiting in the call.
+ */
+static int mpi_all_ok(int ok)
+{
+    int all;
+
+    MPI_Allreduce(&ok, &all, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    return all;
+}
+
+/*
+ * inout = in merged with inout, `in` coming from the lower ranks
+ */
+static void piece_reduce(void *in, void *inout, int *len, __attribute__((unused)) MPI_Datatype *type)
+{
+    piece_t *lower = in;
+    piece_t *upper = inout;
+    int i;
+
+    for (i = 0; i < *len; i++) {
+        piece_t piece = lower[i];
+        piece_merge(&piece, upper[i], tiles_orientation[0]);
+        upper[i] = piece;
+    }
+}
+
+static int limits_mpi(limits_t *limits, uint64_t size, int rank, int nb_rank,
+        struct dragon_perf *perf)
+{
+    struct perf_sample sample;
+    piece_t piece;
+    piece_t master;
+    MPI_Datatype piece_type;
+    MPI_Op op;
+    uint64_t start = rank * size / nb_rank;
+    uint64_t end = (rank + 1) * size / nb_rank;
+
+    /* only tile 0 is walked, the other tiles are rotations of it */
+    piece_init(&piece);
+    piece.orientation = tiles_orientation[0];
+    perf_begin(perf, &sample);
+    piece_limit(start, end, &piece);
+    perf_end(perf, PERF_LIMITS, &sample);
+
+    /* piece_merge is associative but not commutative */
+    MPI_Type_contiguous(sizeof(piece_t), MPI_BYTE, &piece_type);
+    MPI_Type_commit(&piece_type);
+    MPI_Op_create(piece_reduce, 0, &op);
+    MPI_Allreduce(&piece, &master, 1, piece_type, op, MPI_COMM_WORLD);
+    MPI_Op_free(&op);
+    MPI_Type_free(&piece_type);
+
+    *limits = master.limits;
+    merge_tiles_limits(limits, master.limits);
+    return 0;
+}
+
+int dragon_limits_mpi(struct dragon_ctx *ctx, limits_t *limits, uint64_t size)
+{
+    int rank, nb_rank;
+
+    mpi_init(&rank, &nb_rank);
+    if (limits_mpi(limits, size, rank, nb_rank, dragon_ctx_perf(ctx)) < 0)
+        return -1;
+    return rank == 0 ? 0 : 1;
+}
+
+/*
+ * Bounding boxes of all the blocks, each rank computing an even share
+ * of them.
+ */
+static limits_t *blocks_mpi(uint64_t size, int shift, uint64_t nb_blocks, int rank, int nb_rank)
+{
+    uint64_t total = nb_blocks * NB_TILES;
+    limits_t *blocks = NULL;
+    int *counts = NULL, *displs = NULL;
+    int r, ret = -1;
+    uint64_t i;
+
+    blocks = malloc(sizeof(limits_t) * total);
+    counts = malloc(sizeof(int) * nb_rank);
+    displs = malloc(sizeof(int) * nb_rank);
+    if (!mpi_all_ok(blocks != NULL && counts != NULL && displs != NULL))
+        goto done;
+
+    for (r = 0; r < nb_rank; r++) {
+        displs[r] = r * total / nb_rank * sizeof(limits_t);
+        counts[r] = (r + 1) * total / nb_rank * sizeof(limits_t) - displs[r];
+    }
+    for (i = rank * total / nb_rank; i < (rank + 1) * total / nb_rank; i++)
+        block_limit(i / nb_blocks, i % nb_blocks, shift, size, &blocks[i]);
+
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+            blocks, counts, displs, MPI_BYTE, MPI_COMM_WORLD);
+    ret = 0;
+done:
+    FREE(counts);
+    FREE(displs);
+    if (ret < 0)
+        FREE(blocks);
+    return blocks;
+}
+
+/*
+ * The band of the canvas of this rank is kept by the context, the
+ * returned canvas is always NULL.
+ */
+int dragon_draw_mpi(struct dragon_ctx *ctx, char **canvas, struct rgb *image, int width, int height, uint64_t size)
+{
+    int rank, nb_rank;
+    limits_t limits;
+    limits_t *blocks = NULL;
+    char *band = NULL;
+    struct rgb *rows = NULL;
+    int *counts = NULL, *displs = NULL;
+    int dragon_width, dragon_height;
+    int first, last, r;
+    int shift;
+    uint64_t nb_blocks;
+    struct dragon_perf *perf = dragon_ctx_perf(ctx);
+    struct perf_sample sample;
+    int ret = 0;
+
+    mpi_init(&rank, &nb_rank);
+    *canvas = NULL;
+
+    /* 1. Limits over all the ranks */
+    if (limits_mpi(&limits, size, rank, nb_rank, perf) < 0)
+        goto err;
+    dragon_width = limits.maximums.x - limits.minimums.x;
+    dragon_height = limits.maximums.y - limits.minimums.y;
+
+    /* 2. Bounding boxes of blocks of about sqrt(size) segments */
+    for (shift = 8; (1ULL << (2 * shift)) < size; shift++);
+    nb_blocks = (size + (1ULL << shift) - 1) >> shift;
+    if ((blocks = blocks_mpi(size, shift, nb_blocks, rank, nb_rank)) == NULL)
+        goto err;
+
+    /* 3. Draw the band of the canvas read by our rows of the image */
+    int start = rank * height / nb_rank;
+    int end = (rank + 1) * height / nb_rank;
+    scale_source_rows(start, end, width, height, dragon_width, dragon_height, &first, &last);
+
+    band = dragon_ctx_canvas(ctx, (size_t) dragon_width * (last - first) + 1);
+    rows = malloc(sizeof(struct rgb) * width * (end - start) + 1);
+    if (rank == 0) {
+        counts = malloc(sizeof(int) * nb_rank);
+        displs = malloc(sizeof(int) * nb_rank);
+    }
+    if (!mpi_all_ok(band != NULL && rows != NULL &&
+            (rank != 0 || (counts != NULL && displs != NULL))))
+        goto err;
+    perf_begin(perf, &sample);
+    init_canvas(0, dragon_width * (last - first), band, -1);
+    perf_end(perf, PERF_CLEAR, &sample);
+
+    perf_begin(perf, &sample);
+    dragon_draw_band(blocks, nb_blocks, shift, size, ctx->nb_thread,
+            band, dragon_width, first, last, limits);
+    perf_end(perf, PERF_DRAW, &sample);
+
+    /* 4. Render our rows, and gather them on rank 0 */
+    perf_begin(perf, &sample);
+    scale_dragon_band(start, end, rows, width, height,
+            band, first, dragon_width, dragon_height, ctx->palette);
+    perf_end(perf, PERF_RENDER, &sample);
+
+    if (rank == 0) {
+        for (r = 0; r < nb_rank; r++) {
+            displs[r] = r * height / nb_rank * width * sizeof(struct rgb);
+            counts[r] = (r + 1) * height / nb_rank * width * sizeof(struct rgb) - displs[r];
+        }
+    }
+    MPI_Gatherv(rows, (end - start) * width * sizeof(struct rgb), MPI_BYTE,
+            image, counts, displs, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    if (rank != 0)
+        ret = 1;
+done:
+    FREE(blocks);
+    FREE(rows);
+    FREE(counts);
+    FREE(displs);
+    return ret;
+err:
+    ret = -1;
+    goto done;
+}
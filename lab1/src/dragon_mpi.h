@@ -0,0 +1,19 @@
+/*
+ * dragon_mpi.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_MPI_H_
+#define DRAGON_MPI_H_
+
+#include "dragon.h"
+
+/*
+ * Both handlers return 1 on the ranks other than 0, where the result
+ * is not available.
+ */
+int dragon_draw_mpi(struct dragon_ctx *ctx, char **canvas, struct rgb *image, int width, int height, uint64_t size);
+int dragon_limits_mpi(struct dragon_ctx *ctx, limits_t *limits, uint64_t size);
+
+#endif /* DRAGON_MPI_H_ */
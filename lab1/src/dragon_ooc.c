@@ -0,0 +1,186 @@
+/*
+ * dragon_ooc.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Out-of-core draw: the whole canvas never exists, only the bands of it
+ * being drawn do.
+ *
+ * The image is cut in bands of rows, each reading its own rows of the
+ * canvas (see scale_source_rows). A band of the canvas is drawn from the
+ * blocks whose bounding box crosses it, in a buffer of its worker, then
+ * rendered. No band is read again once rendered, so the canvas is not
+ * kept anywhere, and each worker holds one band of the budget.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "dragon.h"
+#include "color.h"
+#include "dragon_ctx.h"
+#include "dragon_ooc.h"
+#include "img_stream.h"
+
+struct ooc_data {
+    int image_width;
+    int image_height;
+    int dragon_width;
+    int dragon_height;
+    int band_rows;          /* image rows per band */
+    size_t band_cells;      /* canvas cells of the largest band */
+    int nb_bands;
+    int shift;              /* log2 of the number of segments per block */
+    int nb_colors;
+    uint64_t size;
+    uint64_t nb_blocks;     /* blocks of each tile orientation */
+    limits_t limits;
+    limits_t *blocks;
+    struct rgb *image;
+    struct img_stream *stream;  /* when set, bands go there instead of image */
+    struct palette *palette;
+    uint64_t next;          /* head of the work queue */
+    int ret;
+};
+
+/* draw the canvas rows of the image rows [start, end) in `band`, and render them */
+static void draw_band(struct ooc_data *data, int start, int end, struct rgb *rows, char *band)
+{
+    int first, last;
+
+    scale_source_rows(start, end, data->image_width, data->image_height,
+            data->dragon_width, data->dragon_height, &first, &last);
+    if (last > first) {
+        init_canvas(0, data->dragon_width * (last - first), band, -1);
+        dragon_draw_band(data->blocks, data->nb_blocks, data->shift, data->size,
+                data->nb_colors, band, data->dragon_width, first, last, data->limits);
+    }
+    scale_dragon_band(start, end, rows,
+            data->image_width, data->image_height, band, first,
+            data->dragon_width, data->dragon_height, data->palette);
+}
+
+static void *blocks_worker(void *arg)
+{
+    struct ooc_data *data = arg;
+    uint64_t total = data->nb_blocks * NB_TILES;
+    uint64_t i;
+
+    while ((i = __sync_fetch_and_add(&data->next, 1)) < total) {
+        block_limit(i / data->nb_blocks, i % data->nb_blocks, data->shift,
+                data->size, &data->blocks[i]);
+    }
+    return NULL;
+}
+
+static void *bands_worker(void *arg)
+{
+    struct ooc_data *data = arg;
+    struct rgb *rows = NULL;
+    char *band;
+    uint64_t i;
+
+    if ((band = malloc(data->band_cells)) == NULL) {
+        fprintf(stderr, "malloc error: %zu bytes\n", data->band_cells);
+        data->ret = -1;
+        return NULL;
+    }
+    for (;;) {
+        /* the buffer is taken before the band, see img_stream.c */
+        if (data->stream != NULL)
+            rows = img_stream_buffer(data->stream);
+        i = __sync_fetch_and_add(&data->next, 1);
+        if (i >= (uint64_t) data->nb_bands)
+            break;
+        int start = i * data->band_rows;
+        int end = start + data->band_rows;
+        if (end > data->image_height)
+            end = data->image_height;
+        if (data->stream == NULL)
+            rows = data->image + (size_t) start * data->image_width;
+        draw_band(data, start, end, rows, band);
+        if (data->stream != NULL)
+            img_stream_write(data->stream, rows, start, end);
+    }
+    if (data->stream != NULL)
+        img_stream_release(data->stream, rows);
+    FREE(band);
+    return NULL;
+}
+
+/* the workers of the context, sharing `data` and its work queue */
+static int run_workers(struct dragon_ctx *ctx, struct ooc_data *data, void *(*worker)(void *))
+{
+    data->next = 0;
+    return dragon_pool_run(ctx, ctx->nb_thread, worker, data, 0);
+}
+
+/*
+ * Render the dragon of `size` segments with the given limits in `image`,
+ * or in `stream` when it is not NULL, keeping about `budget` bytes of
+ * the canvas in memory, with the workers and colors of the context.
+ */
+int dragon_draw_ooc(struct dragon_ctx *ctx, struct rgb *image, int width, int height,
+        limits_t limits, uint64_t size, uint64_t budget, struct img_stream *stream)
+{
+    struct ooc_data data;
+    int nb_thread = ctx->nb_thread;
+    int scale_x, scale_y, scale;
+    uint64_t band_bytes, rows;
+    int ret = 0;
+
+    memset(&data, 0, sizeof(struct ooc_data));
+    data.image = image;
+    data.stream = stream;
+    data.image_width = width;
+    data.image_height = height;
+    data.dragon_width = limits.maximums.x - limits.minimums.x;
+    data.dragon_height = limits.maximums.y - limits.minimums.y;
+    data.limits = limits;
+    data.size = size;
+    data.nb_colors = nb_thread;
+
+    /* a row of the image reads `scale` rows of the canvas */
+    scale_x = data.dragon_width / width + 1;
+    scale_y = data.dragon_height / height + 1;
+    scale = scale_x > scale_y ? scale_x : scale_y;
+    band_bytes = (uint64_t) scale * data.dragon_width;
+    rows = budget / (band_bytes * nb_thread);
+    /* init_canvas and the band indexes are int */
+    if (rows > INT_MAX / band_bytes)
+        rows = INT_MAX / band_bytes;
+    if (rows > (uint64_t) height)
+        rows = height;
+    if (stream != NULL && rows > (uint64_t) img_stream_rows(stream))
+        rows = img_stream_rows(stream);
+    data.band_rows = rows > 0 ? rows : 1;
+    data.nb_bands = (height + data.band_rows - 1) / data.band_rows;
+    data.band_cells = (size_t) data.band_rows * band_bytes;
+
+    /* blocks of about sqrt(size) segments, as for the MPI draw */
+    for (data.shift = 8; (1ULL << (2 * data.shift)) < size; data.shift++);
+    data.nb_blocks = (size + (1ULL << data.shift) - 1) >> data.shift;
+
+    data.palette = ctx->palette;
+    data.blocks = malloc(sizeof(limits_t) * data.nb_blocks * NB_TILES);
+    if (data.blocks == NULL)
+        goto err;
+
+    /* 1. Bounding box of each block */
+    if (run_workers(ctx, &data, blocks_worker) < 0)
+        goto err;
+
+    /* 2. Bands of the image, each drawn in the buffer of its worker */
+    if (run_workers(ctx, &data, bands_worker) < 0 || data.ret < 0)
+        goto err;
+
+done:
+    FREE(data.blocks);
+    return ret;
+err:
+    ret = -1;
+    goto done;
+}
@@ -0,0 +1,17 @@
+/*
+ * dragon_ooc.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_OOC_H_
+#define DRAGON_OOC_H_
+
+#include "dragon.h"
+#include "dragon_ctx.h"
+#include "img_stream.h"
+
+int dragon_draw_ooc(struct dragon_ctx *ctx, struct rgb *image, int width, int height,
+        limits_t limits, uint64_t size, uint64_t budget, struct img_stream *stream);
+
+#endif /* DRAGON_OOC_H_ */
@@ -0,0 +1,215 @@
+/*
+ * dragon_perf.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Hardware counters of the phases of the draws, through perf_event_open.
+ * Each thread opens one group of counters of itself, kept until it ends,
+ * and reads the whole group at once at the start and end of a phase.
+ * Only the user space is counted, as allowed by a perf_event_paranoid
+ * of 2. The events the kernel or the processor refuses are left out of
+ * the group, and without any event the thread samples nothing.
+ *
+ * When the kernel multiplexes the counters, the values are scaled by the
+ * time the group was enabled over the time it ran, as perf stat does.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "dragon_perf.h"
+
+static const char *phase_names[NB_PERF_PHASES] = {
+    "limits", "clear", "draw", "render",
+};
+
+static const char *event_names[NB_PERF_EVENTS] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses",
+};
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[NB_PERF_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+enum group_state {
+    GROUP_CLOSED = 0,
+    GROUP_OPEN,
+    GROUP_REFUSED,
+};
+
+struct perf_group {
+    enum group_state state;
+    int nb;                         /* counters of the group */
+    int fd[NB_PERF_EVENTS];         /* fd[0] leads the group */
+    int event[NB_PERF_EVENTS];      /* event of the i-th counter */
+    unsigned int mask;              /* events of the group */
+    int error;                      /* errno of the first refused event */
+};
+
+struct group_read {
+    uint64_t nr;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t value[NB_PERF_EVENTS];
+};
+
+static __thread struct perf_group group;
+static pthread_key_t group_key;
+static pthread_once_t group_once = PTHREAD_ONCE_INIT;
+
+/* close the counters of a thread at its end */
+static void group_close(void *arg)
+{
+    struct perf_group *g = arg;
+    int i;
+
+    for (i = 0; i < g->nb; i++)
+        close(g->fd[i]);
+    g->nb = 0;
+    g->mask = 0;
+    g->state = GROUP_CLOSED;
+}
+
+static void group_key_init(void)
+{
+    pthread_key_create(&group_key, group_close);
+}
+
+static int event_open(int event, int leader)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(struct perf_event_attr));
+    attr.size = sizeof(struct perf_event_attr);
+    attr.type = events[event].type;
+    attr.config = events[event].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+/* open the counters of the calling thread */
+static void group_open(void)
+{
+    int i, fd;
+
+    for (i = 0; i < NB_PERF_EVENTS; i++) {
+        fd = event_open(i, group.nb > 0 ? group.fd[0] : -1);
+        if (fd < 0) {
+            if (group.error == 0)
+                group.error = errno;
+            continue;
+        }
+        group.fd[group.nb] = fd;
+        group.event[group.nb] = i;
+        group.mask |= 1U << i;
+        group.nb++;
+    }
+    if (group.nb == 0) {
+        group.state = GROUP_REFUSED;
+        return;
+    }
+    pthread_once(&group_once, group_key_init);
+    pthread_setspecific(group_key, &group);
+    group.state = GROUP_OPEN;
+}
+
+static int group_sample(struct perf_sample *sample)
+{
+    struct group_read buf;
+    int i;
+
+    if (read(group.fd[0], &buf, sizeof(struct group_read)) < 0 ||
+            buf.nr != (uint64_t) group.nb)
+        return -1;
+    memset(sample->value, 0, sizeof(sample->value));
+    for (i = 0; i < group.nb; i++) {
+        uint64_t v = buf.value[i];
+        if (buf.time_running > 0 && buf.time_running < buf.time_enabled)
+            v = (double) v * buf.time_enabled / buf.time_running;
+        sample->value[group.event[i]] = v;
+    }
+    return 0;
+}
+
+void perf_begin(struct dragon_perf *perf, struct perf_sample *sample)
+{
+    sample->valid = 0;
+    if (perf == NULL)
+        return;
+    if (group.state == GROUP_CLOSED)
+        group_open();
+    /* the group of a thread may be shared by several contexts */
+    if (group.error != 0 && perf->error == 0)
+        __sync_bool_compare_and_swap(&perf->error, 0, group.error);
+    if (group.state != GROUP_OPEN)
+        return;
+    if ((perf->events & group.mask) != group.mask)
+        __sync_fetch_and_or(&perf->events, group.mask);
+    sample->valid = group_sample(sample) == 0;
+}
+
+void perf_end(struct dragon_perf *perf, enum perf_phase phase, struct perf_sample *sample)
+{
+    struct perf_sample end;
+    int i;
+
+    if (perf == NULL || !sample->valid || group_sample(&end) < 0)
+        return;
+    for (i = 0; i < NB_PERF_EVENTS; i++)
+        if (end.value[i] > sample->value[i])
+            __sync_fetch_and_add(&perf->count[phase][i], end.value[i] - sample->value[i]);
+    __sync_fetch_and_add(&perf->samples[phase], 1);
+}
+
+void perf_reset(struct dragon_perf *perf)
+{
+    memset(perf->samples, 0, sizeof(perf->samples));
+    memset(perf->count, 0, sizeof(perf->count));
+}
+
+/*
+ * One line per phase, with the number of samples and the totals of the
+ * events; the events that were never counted are left empty.
+ */
+int perf_dump_csv(struct dragon_perf *perf, FILE *out)
+{
+    int p, e;
+
+    if (perf->error != 0)
+        fprintf(stderr, "perf_event_open: %s%s\n", strerror(perf->error),
+                perf->events == 0 ? ", nothing counted" : ", some events left out");
+    fprintf(out, "phase,samples");
+    for (e = 0; e < NB_PERF_EVENTS; e++)
+        fprintf(out, ",%s", event_names[e]);
+    fprintf(out, "\n");
+    for (p = 0; p < NB_PERF_PHASES; p++) {
+        fprintf(out, "%s,%"PRIu64, phase_names[p], perf->samples[p]);
+        for (e = 0; e < NB_PERF_EVENTS; e++) {
+            if (perf->events & (1U << e))
+                fprintf(out, ",%"PRIu64, perf->count[p][e]);
+            else
+                fprintf(out, ",");
+        }
+        fprintf(out, "\n");
+    }
+    return ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * dragon_perf.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_PERF_H_
+#define DRAGON_PERF_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum perf_phase {
+	PERF_LIMITS,
+	PERF_CLEAR,
+	PERF_DRAW,
+	PERF_RENDER,
+	NB_PERF_PHASES,
+};
+
+enum perf_event {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_LLC_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_BRANCH_MISSES,
+	NB_PERF_EVENTS,
+};
+
+/*
+ * Hardware counters of the phases, summed over the threads of the
+ * phases. Each thread counts with its own counters, opened on its
+ * first sample, and adds what a phase counted between perf_begin and
+ * perf_end. A thread whose counters are refused by the kernel samples
+ * nothing, and the first error is kept to be reported.
+ */
+struct dragon_perf {
+	int enabled;
+	int error;              /* errno of the first refused counter */
+	unsigned int events;    /* mask of the events counted */
+	uint64_t samples[NB_PERF_PHASES];
+	uint64_t count[NB_PERF_PHASES][NB_PERF_EVENTS];
+};
+
+struct perf_sample {
+	int valid;
+	uint64_t value[NB_PERF_EVENTS];
+};
+
+/* both do nothing with a NULL perf, the counting being off */
+void perf_begin(struct dragon_perf *perf, struct perf_sample *sample);
+void perf_end(struct dragon_perf *perf, enum perf_phase phase, struct perf_sample *sample);
+void perf_reset(struct dragon_perf *perf);
+int perf_dump_csv(struct dragon_perf *perf, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRAGON_PERF_H_ */
@@ -0,0 +1,187 @@
+/*
+ * dragon_progressive.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Draw in passes of increasing density, the image of each pass being
+ * given to a callback. The segments are split in blocks of about
+ * sqrt(size) segments, spread over the whole dragon: the first pass
+ * draws one block every 2^(nb_passes - 1), and each next pass draws the
+ * blocks halfway between the ones already drawn, doubling the density.
+ * Every block is drawn once, by the first pass showing it.
+ *
+ * The blocks are drawn out of order, so the cells keep the highest id
+ * (see dragon_draw_atomic) and the last pass leaves the canvas, and the
+ * image, of the serial draw. With a single color, any order gives the
+ * same canvas, and the plain stores are kept.
+ *
+ * The blocks of a pass are spread over the whole dragon and cross about
+ * every row of the image, so each pass renders the whole image again;
+ * rendering only the rows a pass wrote would spare next to nothing.
+ * Reading the whole canvas would then cost a full render per pass: the
+ * passes before the last one average only a few canvas rows under each
+ * pixel, and the last one renders the image from all the cells.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "dragon.h"
+#include "color.h"
+#include "dragon_ctx.h"
+#include "dragon_perf.h"
+#include "dragon_progressive.h"
+
+typedef int (*draw_tiles_fn)(uint64_t, uint64_t, char *, int, int, limits_t, char);
+
+struct progressive {
+    char *dragon;
+    limits_t limits;
+    int dragon_width;
+    int dragon_height;
+    struct rgb *image;
+    int width;
+    int height;
+    int row_step;           /* canvas rows read by the previews */
+    uint64_t size;
+    int shift;
+    int nb_colors;
+    draw_tiles_fn draw;
+    struct dragon_perf *perf;
+};
+
+/* draw a block on the four tiles, split by colors */
+static int draw_block(struct progressive *prog, uint64_t block)
+{
+    uint64_t n = block << prog->shift;
+    uint64_t stop = n + (1ULL << prog->shift);
+
+    if (stop > prog->size)
+        stop = prog->size;
+    while (n < stop) {
+        int m = segment_color(n, prog->size, prog->nb_colors);
+        uint64_t next = (m + 1) * prog->size / prog->nb_colors;
+        if (next > stop)
+            next = stop;
+        if (prog->draw(n, next, prog->dragon, prog->dragon_width,
+                prog->dragon_height, prog->limits, m) < 0)
+            return -1;
+        n = next;
+    }
+    return 0;
+}
+
+/* blocks first, first + step, ... of the pass, with the team */
+static int draw_pass(struct progressive *prog, uint64_t first, uint64_t step, int nb_thread)
+{
+    uint64_t nb_blocks = (prog->size + (1ULL << prog->shift) - 1) >> prog->shift;
+    int64_t nb = first < nb_blocks ? (nb_blocks - first + step - 1) / step : 0;
+    int64_t i;
+    int err = 0;
+
+    #pragma omp parallel num_threads(nb_thread) reduction(|:err)
+    {
+        struct perf_sample sample;
+        perf_begin(prog->perf, &sample);
+        #pragma omp for schedule(dynamic, 16)
+        for (i = 0; i < nb; i++)
+            err |= draw_block(prog, first + i * step) < 0;
+        perf_end(prog->perf, PERF_DRAW, &sample);
+    }
+    return err ? -1 : 0;
+}
+
+/* canvas rows averaged under a pixel of the previews */
+#define PREVIEW_ROWS 4
+
+/* image rows rendered by a task */
+#define RENDER_ROWS 8
+
+static void render(struct progressive *prog, struct palette *palette, int row_step,
+        int nb_thread)
+{
+    int y;
+
+    #pragma omp parallel num_threads(nb_thread)
+    {
+        struct perf_sample sample;
+        perf_begin(prog->perf, &sample);
+        #pragma omp for schedule(dynamic, 1)
+        for (y = 0; y < prog->height; y += RENDER_ROWS) {
+            int end = y + RENDER_ROWS < prog->height ? y + RENDER_ROWS : prog->height;
+            scale_dragon_sampled(y, end, prog->image, prog->width, prog->height, prog->dragon,
+                    prog->dragon_width, prog->dragon_height, palette, row_step);
+        }
+        perf_end(prog->perf, PERF_RENDER, &sample);
+    }
+}
+
+/*
+ * Draw the dragon of `size` segments in nb_passes passes with the team
+ * of the context, calling `progress` after each one with the image.
+ */
+int dragon_progressive(struct dragon_ctx *ctx, struct rgb *image, int width, int height,
+        uint64_t size, int nb_passes, progress_fn progress, void *data)
+{
+    struct progressive prog;
+    struct perf_sample sample;
+    int nb_thread = ctx->nb_thread;
+    int levels = nb_passes - 1;
+    int scale_x, scale_y, scale;
+    int pass, ret = 0;
+    size_t area;
+
+    memset(&prog, 0, sizeof(struct progressive));
+    prog.image = image;
+    prog.width = width;
+    prog.height = height;
+    prog.size = size;
+    prog.nb_colors = nb_thread;
+    prog.draw = nb_thread > 1 ? dragon_draw_tiles_atomic : dragon_draw_tiles;
+    prog.perf = dragon_ctx_perf(ctx);
+
+    if (dragon_ctx_limits(ctx, dragon_limits_serial, &prog.limits, size) < 0)
+        goto err;
+    prog.dragon_width = prog.limits.maximums.x - prog.limits.minimums.x;
+    prog.dragon_height = prog.limits.maximums.y - prog.limits.minimums.y;
+    area = (size_t) prog.dragon_width * prog.dragon_height;
+    if ((prog.dragon = dragon_ctx_canvas(ctx, area)) == NULL)
+        goto err;
+
+    /* canvas rows under an image row, as in scale_dragon */
+    scale_x = prog.dragon_width / width + 1;
+    scale_y = prog.dragon_height / height + 1;
+    scale = scale_x > scale_y ? scale_x : scale_y;
+    prog.row_step = scale > PREVIEW_ROWS ? scale / PREVIEW_ROWS : 1;
+
+    /* blocks of about sqrt(size) segments, and at least one per pass */
+    for (prog.shift = 8; (1ULL << (2 * prog.shift)) < size; prog.shift++);
+    while (prog.shift > 0 && (size >> prog.shift) < (1ULL << levels))
+        prog.shift--;
+
+    perf_begin(prog.perf, &sample);
+    init_canvas(0, area, prog.dragon, -1);
+    perf_end(prog.perf, PERF_CLEAR, &sample);
+
+    for (pass = 0; pass < nb_passes; pass++) {
+        uint64_t first = pass == 0 ? 0 : 1ULL << (levels - pass);
+        uint64_t step = pass == 0 ? 1ULL << levels : 1ULL << (levels - pass + 1);
+        int row_step = pass < levels ? prog.row_step : 1;
+        if (draw_pass(&prog, first, step, nb_thread) < 0)
+            goto err;
+        render(&prog, ctx->palette, row_step, nb_thread);
+        if (progress != NULL && progress(pass, nb_passes, image, width, height, data) < 0)
+            goto err;
+    }
+
+done:
+    return ret;
+err:
+    ret = -1;
+    goto done;
+}
@@ -0,0 +1,20 @@
+/*
+ * dragon_progressive.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_PROGRESSIVE_H_
+#define DRAGON_PROGRESSIVE_H_
+
+#include "dragon.h"
+#include "dragon_ctx.h"
+
+/* called with the image of each pass, a negative return stops the draw */
+typedef int (*progress_fn)(int pass, int nb_passes, struct rgb *image, int width, int height,
+        void *data);
+
+int dragon_progressive(struct dragon_ctx *ctx, struct rgb *image, int width, int height,
+        uint64_t size, int nb_passes, progress_fn progress, void *data);
+
+#endif /* DRAGON_PROGRESSIVE_H_ */
@@ -8,7 +8,6 @@
 #define _GNU_SOURCE
 #include <stdlib.h>
 #include <pthread.h>
-#include <stdarg.h>
 #include <string.h>
 #include <errno.h>
 
@@ -16,23 +15,12 @@
 #include "dragon.h"
 #include "color.h"
 #include "dragon_pthread.h"
+#include "dragon_ctx.h"
+#include "affinity.h"
 
 #define PRINT_PTHREAD_ERROR(err, msg) \
     do { errno = err; perror(msg); } while(0)
 
-pthread_mutex_t mutex_stdout;
-
-void printf_threadsafe(char *format, ...)
-{
-    va_list ap;
-
-    va_start(ap, format);
-    pthread_mutex_lock(&mutex_stdout);
-    vprintf(format, ap);
-    pthread_mutex_unlock(&mutex_stdout);
-    va_end(ap);
-}
-
 /**
  * Does the work on a part of the dragon.
  * Returns 0 on success.
@@ -41,12 +29,15 @@ void* dragon_draw_worker(void *data)
 {
     struct draw_data info = *((struct draw_data*)data);
     int area = info.dragon_width * info.dragon_height;
+    struct perf_sample sample;
 
     /* 1. Initialiser la surface */
     int canvasStart = ((uint64_t)info.id)*area/(long int)info.nb_thread;
     int canvasEnd = ((uint64_t)(info.id+1))*area/(long int)info.nb_thread;
-    
+
+    perf_begin(info.perf, &sample);
     init_canvas(canvasStart, canvasEnd, info.dragon, -1);
+    perf_end(info.perf, PERF_CLEAR, &sample);
 
     pthread_barrier_wait(info.barrier);
     /* 2. Dessiner les dragons dans les 4 directions
@@ -59,14 +50,18 @@ void* dragon_draw_worker(void *data)
     uint64_t end = (info.id + 1) * info.size / info.nb_thread;
 
     /*
-        * Le premier argument (tile) contrôle la direction vers laquelle
-        * le dragon est dessiné.
+        * Les 4 tuiles sont dessinées en un seul parcours.
         */
-    for(int tile = 0; tile < NB_TILES; tile++) {
-        dragon_draw_raw(tile, start, end, 
-        info.dragon, info.dragon_width, info.dragon_height, 
+    perf_begin(info.perf, &sample);
+    if (info.deterministic)
+        dragon_draw_tiles_atomic(start, end,
+        info.dragon, info.dragon_width, info.dragon_height,
         info.limits, info.id);
-    }
+    else
+        dragon_draw_tiles(start, end,
+        info.dragon, info.dragon_width, info.dragon_height,
+        info.limits, info.id);
+    perf_end(info.perf, PERF_DRAW, &sample);
 
     pthread_barrier_wait(info.barrier);
 
@@ -74,17 +69,91 @@ void* dragon_draw_worker(void *data)
     end = (info.id + 1) * info.image_height / info.nb_thread;
 
     /* 3. Effectuer le rendu final */
-    scale_dragon(start, end, info.image, info.image_width, info.image_height, info.dragon, info.dragon_width, info.dragon_height, info.palette);
+    if (info.image != NULL) {
+        perf_begin(info.perf, &sample);
+        scale_dragon(start, end, info.image, info.image_width, info.image_height, info.dragon, info.dragon_width, info.dragon_height, info.palette);
+        perf_end(info.perf, PERF_RENDER, &sample);
+    }
     pthread_barrier_wait(info.barrier);
 
     return NULL;
 }
 
-int dragon_draw_pthread(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread)
+/* default bands per thread, taken from a shared counter to balance the load */
+#define BANDS_PER_THREAD 4
+
+struct band_data {
+    int id;
+    int nb_thread;
+    int nb_bands;
+    uint64_t *next;
+    struct band_plan *plan;
+};
+
+/* 1. Boîtes englobantes des blocs de segments */
+void *dragon_blocks_worker(void *data)
+{
+    struct band_data *info = (struct band_data *) data;
+
+    band_plan_blocks(info->plan, info->id, info->nb_thread);
+    return NULL;
+}
+
+/* 2. Effacer, dessiner et rendre des bandes de l'image */
+void *dragon_band_worker(void *data)
+{
+    struct band_data *info = (struct band_data *) data;
+    uint64_t band;
+
+    while ((band = __sync_fetch_and_add(info->next, 1)) < (uint64_t) info->nb_bands)
+        band_plan_draw(info->plan, band, info->nb_bands);
+    return NULL;
+}
+
+/**
+ * Draw with `nb_worker` threads of the pool, pinned with the affinity of
+ * the context, each band of the canvas being cleared, drawn and rendered
+ * by the same thread. The workers are independent of the colors.
+ */
+static int dragon_draw_bands(struct dragon_ctx *ctx, char *dragon, struct rgb *image,
+        int width, int height, limits_t limits, uint64_t size, int nb_worker, int nb_chunks)
+{
+    struct band_data *data = NULL;
+    struct band_plan plan;
+    uint64_t next = 0;
+    int i, ret = 0;
+
+    if (band_plan_init(&plan, dragon, limits, size, ctx->nb_thread, image, width, height,
+                ctx->palette) < 0)
+        goto err;
+    plan.perf = dragon_ctx_perf(ctx);
+    if ((data = calloc(nb_worker, sizeof(struct band_data))) == NULL)
+        goto err;
+
+    for (i = 0; i < nb_worker; i++) {
+        data[i].id = i;
+        data[i].nb_thread = nb_worker;
+        data[i].nb_bands = nb_worker * nb_chunks;
+        data[i].next = &next;
+        data[i].plan = &plan;
+    }
+    if (dragon_pool_run(ctx, nb_worker, dragon_blocks_worker, data, sizeof(struct band_data)) < 0 ||
+        dragon_pool_run(ctx, nb_worker, dragon_band_worker, data, sizeof(struct band_data)) < 0)
+        goto err;
+
+done:
+    band_plan_free(&plan);
+    FREE(data);
+    return ret;
+err:
+    ret = -1;
+    goto done;
+}
+
+int dragon_draw_pthread(struct dragon_ctx *ctx, char **canvas, struct rgb *image, int width, int height, uint64_t size)
 {
     //TODO("dragon_draw_pthread");
     
-    pthread_t *threads = NULL;
     pthread_barrier_t barrier;
     limits_t lim;
     struct draw_data info;
@@ -92,40 +161,44 @@ int dragon_draw_pthread(char **canvas, struct rgb *image, int width, int height,
     int scale_x;
     int scale_y;
     struct draw_data *data = NULL;
-    struct palette *palette = NULL;
+    int nb_thread = ctx->nb_thread;
     int ret = 0;
 
-    palette = init_palette(nb_thread);
-    if (palette == NULL)
-        goto err;
-
     /* 1. Initialiser barrier. */
     if(pthread_barrier_init(&barrier, NULL, nb_thread) != 0) {
         printf("barrier init error\n");
         goto err;
     }
 
-    info.dragon_width = lim.maximums.x - lim.minimums.x;
-    info.dragon_height = lim.maximums.y - lim.minimums.y;
-
-    if (dragon_limits_pthread(&lim, size, nb_thread) < 0)
+    memset(&lim, 0, sizeof(limits_t));
+    if (dragon_limits_pthread(ctx, &lim, size) < 0)
         goto err;
 
     info.dragon_width = lim.maximums.x - lim.minimums.x;
     info.dragon_height = lim.maximums.y - lim.minimums.y;
 
-    if ((dragon = (char *) malloc(info.dragon_width * info.dragon_height)) == NULL) {
+    /* la surface est gardée par le contexte d'un appel à l'autre */
+    if ((dragon = dragon_ctx_canvas(ctx, (size_t) info.dragon_width * info.dragon_height)) == NULL) {
         printf("malloc error dragon. width : %d, height : %d\n", info.dragon_width, info.dragon_height);
         goto err;
     }
 
-    if ((data = malloc(sizeof(struct draw_data) * nb_thread)) == NULL) {
-        printf("malloc error data\n");
-        goto err;
+    /*
+     * Avec des threads épinglés ou un nombre de threads réglé, chaque
+     * thread garde ses bandes du dessin.
+     */
+    if (ctx->affinity != AFFINITY_NONE || ctx->tuning.draw_workers > 0 ||
+            ctx->tuning.draw_chunks > 0) {
+        int nb_worker = ctx->tuning.draw_workers > 0 ? ctx->tuning.draw_workers : nb_thread;
+        int nb_chunks = ctx->tuning.draw_chunks > 0 ? ctx->tuning.draw_chunks : BANDS_PER_THREAD;
+        if (dragon_draw_bands(ctx, dragon, image, width, height, lim, size, nb_worker, nb_chunks) < 0)
+            goto err;
+        pthread_barrier_destroy(&barrier);
+        goto done;
     }
 
-    if ((threads = malloc(sizeof(pthread_t) * nb_thread)) == NULL) {
-        printf("malloc error threads\n");
+    if ((data = malloc(sizeof(struct draw_data) * nb_thread)) == NULL) {
+        printf("malloc error data\n");
         goto err;
     }
 
@@ -142,20 +215,22 @@ int dragon_draw_pthread(char **canvas, struct rgb *image, int width, int height,
     info.size = size;
     info.limits = lim;
     info.barrier = &barrier;
-    info.palette = palette;
+    info.palette = ctx->palette;
+    info.deterministic = ctx->deterministic;
+    info.perf = dragon_ctx_perf(ctx);
 
-    /* 2. Lancement du calcul parallèle principal avec dragon_draw_worker */
+    /*
+     * 2. Lancement du calcul parallèle principal avec dragon_draw_worker
+     * sur les threads du contexte, 3. et attente de la fin du traitement
+     */
     for(int i = 0; i < nb_thread; i++)
     {
         data[i] = info;
         data[i].id = i;
-        pthread_create(&threads[i], NULL, dragon_draw_worker, &data[i]);
     }
-
-    /* 3. Attendre la fin du traitement */
-    for(int i = 0; i < nb_thread; i++)
-    {
-        pthread_join(threads[i], NULL);
+    if (dragon_pool_run(ctx, nb_thread, dragon_draw_worker, data, sizeof(struct draw_data)) < 0) {
+        pthread_barrier_destroy(&barrier);
+        goto err;
     }
 
     /* 4. Destruction des variables. */
@@ -167,28 +242,27 @@ int dragon_draw_pthread(char **canvas, struct rgb *image, int width, int height,
 
 done:
     FREE(data);
-    FREE(threads);
-    free_palette(palette);
     *canvas = dragon;
     //*canvas = NULL; // TODO: retourner le dragon calculé
     return ret;
 
 err:
-    FREE(dragon);
+    dragon = NULL;
     ret = -1;
     goto done;
 }
 
 void *dragon_limit_worker(void *data)
 {
-    int i;
     struct limit_data *lim = (struct limit_data *) data;
     int start = lim->start;
     int end = lim->end;
+    struct perf_sample sample;
 
-    for (i = 0; i < NB_TILES; i++) {
-        piece_limit(start, end, &lim->pieces[i]);
-    }
+    /* seule la tuile 0 est parcourue */
+    perf_begin(lim->perf, &sample);
+    piece_limit(start, end, &lim->piece);
+    perf_end(lim->perf, PERF_LIMITS, &sample);
 
     return NULL;
 }
@@ -197,34 +271,31 @@ void *dragon_limit_worker(void *data)
  * Calcule les limites en terme de largeur et de hauteur de
  * la forme du dragon. Requis pour allouer la matrice de dessin.
  */
-int dragon_limits_pthread(limits_t *limits, uint64_t size, int nb_thread)
+int dragon_limits_pthread(struct dragon_ctx *ctx, limits_t *limits, uint64_t size)
 {
     //TODO("dragon_limits_pthread");
 
     int ret = 0;
-    pthread_t *threads = NULL;
     struct limit_data *thread_data = NULL;
-    piece_t masters[NB_TILES];
-
-    for (int tile = 0; tile < NB_TILES; tile++) {
-        /**
-         * La pièce master représente les limites d'un dragon complet.
-         * Notez bien que chaque dragon à une orientation différente.
-         */
-        piece_init(&masters[tile]);
-        masters[tile].orientation = tiles_orientation[tile];
-    }
+    piece_t master;
+    int nb_thread = ctx->nb_thread;
+
+    /* les limites ne dépendent pas du nombre de couleurs */
+    if (ctx->tuning.limits_workers > 0)
+        nb_thread = ctx->tuning.limits_workers;
 
-    /* 1. Allouer de l'espace pour threads et threads_data. */
+    /**
+     * La pièce master représente les limites du dragon de la tuile 0,
+     * les autres tuiles en sont déduites par rotation.
+     */
+    piece_init(&master);
+    master.orientation = tiles_orientation[0];
+
+    /* 1. Allouer de l'espace pour threads_data, les threads sont ceux du contexte. */
     if ((thread_data = calloc(nb_thread, sizeof(struct limit_data))) == NULL) {
         printf("malloc error data\n");
         goto err;
     }
-
-    if ((threads = calloc(nb_thread, sizeof(pthread_t))) == NULL) {
-        printf("malloc error threads\n");
-        goto err;
-    }
     
     /* 2. Lancement du calcul en parallèle avec dragon_limit_worker. */
     for(int thread = 0; thread < nb_thread; thread++)
@@ -232,49 +303,29 @@ int dragon_limits_pthread(limits_t *limits, uint64_t size, int nb_thread)
         thread_data[thread].id = thread;
         thread_data[thread].start = thread*size/nb_thread;
         thread_data[thread].end = (thread+1)*size/nb_thread;
-        for(int tile =0; tile<NB_TILES;tile++){
-            piece_init(&(thread_data[thread].pieces[tile]));
-            thread_data[thread].pieces[tile].orientation = tiles_orientation[tile];
-        }
-        if(pthread_create(&threads[thread], 
-                       NULL, 
-                       dragon_limit_worker,
-                       &thread_data[thread]) != 0) {
-                           printf("pthread create error\n");
-                           goto err;
-                       }
+        piece_init(&thread_data[thread].piece);
+        thread_data[thread].piece.orientation = tiles_orientation[0];
+        thread_data[thread].perf = dragon_ctx_perf(ctx);
     }
-    
+
     /* 3. Attendre la fin du traitement. */
-    for(int i = 0; i < nb_thread; i++)
-    {
-        pthread_join(threads[i],NULL);
-    }
+    if (dragon_pool_run(ctx, nb_thread, dragon_limit_worker, thread_data, sizeof(struct limit_data)) < 0)
+        goto err;
     
 
     /* 4. Fusion des pièces.
      *
      * La fonction piece_merge est disponible afin d'accomplir ceci.
-     * Notez bien que les pièces ayant la même orientation initiale
-     * doivent être fusionnées ensemble.
      * */
-    for (int i = 0; i < NB_TILES; i++) {
-        for(int j = 0; j< nb_thread; j++){
-            piece_merge(&masters[i], thread_data[j].pieces[i], tiles_orientation[i]);
-        }
+    for(int j = 0; j< nb_thread; j++){
+        piece_merge(&master, thread_data[j].piece, tiles_orientation[0]);
     }
 
-    /* La limite globale est calculée à partir des limites
-     * de chaque dragon calculées à l'étape 4.
-     */
-    merge_limits(&masters[0].limits, &masters[1].limits);
-    merge_limits(&masters[0].limits, &masters[2].limits);
-    merge_limits(&masters[0].limits, &masters[3].limits);
-
 done:
-    FREE(threads);
     FREE(thread_data);
-    *limits = masters[0].limits;
+    /* La limite globale est déduite des limites de la tuile 0 */
+    *limits = master.limits;
+    merge_tiles_limits(limits, master.limits);
     return ret;
 err:
     ret = -1;
@@ -10,7 +10,7 @@
 
 #include "dragon.h"
 
-int dragon_draw_pthread(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
-int dragon_limits_pthread(limits_t *lim, uint64_t size, int nb_thread);
+int dragon_draw_pthread(struct dragon_ctx *ctx, char **canvas, struct rgb *image, int width, int height, uint64_t size);
+int dragon_limits_pthread(struct dragon_ctx *ctx, limits_t *lim, uint64_t size);
 
 #endif /* DRAGON_PTHREAD_H_ */
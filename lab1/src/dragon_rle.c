@@ -0,0 +1,329 @@
+/*
+ * dragon_rle.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Canvas stored as runs of cells of the same color, row by row. Most of
+ * the bounding box of the dragon is empty or filled by long runs, so the
+ * runs take a fraction of the dragon_width x dragon_height cells of the
+ * char canvas, and the render reads them instead of every cell.
+ *
+ * The canvas is drawn by bands of rows, each thread of the team drawing
+ * a band in its own small buffer with dragon_draw_band, from the boxes
+ * of the blocks of band_plan_blocks, then encoding the rows of the band
+ * in runs. The runs of the bands are merged in row order at the end. The
+ * cells are those of the serial draw, and so is the image.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "dragon.h"
+#include "color.h"
+#include "dragon_ctx.h"
+#include "dragon_perf.h"
+#include "dragon_rle.h"
+
+/*
+ * cells of the buffer of a band: the blocks crossing several bands are
+ * walked by each, so the bands are kept well above the height of a block
+ */
+#define RLE_BAND_CELLS (1 << 23)
+
+/* runs of the rows of a band, before the merge */
+struct rle_band {
+    struct rle_run *runs;
+    size_t nb_runs;
+    size_t capacity;
+};
+
+static int band_push(struct rle_band *band, int start, int length, char id)
+{
+    struct rle_run *run;
+
+    if (band->nb_runs == band->capacity) {
+        size_t capacity = band->capacity > 0 ? 2 * band->capacity : 256;
+        run = realloc(band->runs, capacity * sizeof(struct rle_run));
+        if (run == NULL) {
+            printf("malloc error rle runs\n");
+            return -1;
+        }
+        band->runs = run;
+        band->capacity = capacity;
+    }
+    run = &band->runs[band->nb_runs++];
+    run->start = start;
+    run->length = length;
+    run->id = id;
+    return 0;
+}
+
+/* first cell from j whose 8 bytes are not all `cell`, the cells being read by words */
+static inline int skip_words(const char *row, int j, int width, char cell)
+{
+    uint64_t word, pattern = 0x0101010101010101ULL * (unsigned char) cell;
+
+    while (j + 8 <= width) {
+        memcpy(&word, row + j, sizeof(word));
+        if (word != pattern)
+            break;
+        j += 8;
+    }
+    return j;
+}
+
+/* append the runs of the rows of `cells`, counting them in counts[] */
+static int encode_rows(struct rle_band *band, const char *cells, int width, int nb_rows,
+        size_t *counts)
+{
+    int r, j;
+
+    for (r = 0; r < nb_rows; r++) {
+        const char *row = cells + (size_t) r * width;
+        size_t first = band->nb_runs;
+        j = 0;
+        while (j < width) {
+            char id = row[j];
+            int start = j;
+            j = skip_words(row, j, width, id);
+            while (j < width && row[j] == id)
+                j++;
+            if (id < 0)
+                continue;
+            if (band_push(band, start, j - start, id) < 0)
+                return -1;
+        }
+        counts[r] = band->nb_runs - first;
+    }
+    return 0;
+}
+
+/*
+ * Draw the `size` segments of the four tiles in `canvas`, with the
+ * colors of the threads of the context.
+ */
+int rle_canvas_draw(struct dragon_ctx *ctx, struct rle_canvas *canvas, uint64_t size)
+{
+    struct band_plan plan;
+    struct rle_band *bands = NULL;
+    limits_t limits;
+    int nb_thread = ctx->nb_thread;
+    int band_rows, nb_bands, b, i, ret = 0, err = 0;
+
+    memset(canvas, 0, sizeof(struct rle_canvas));
+    memset(&plan, 0, sizeof(struct band_plan));
+    if (dragon_ctx_limits(ctx, dragon_limits_serial, &limits, size) < 0)
+        goto err;
+    if (band_plan_init(&plan, NULL, limits, size, nb_thread, NULL, 0, 0, NULL) < 0) {
+        printf("malloc error blocks\n");
+        goto err;
+    }
+    plan.perf = dragon_ctx_perf(ctx);
+    canvas->width = plan.dragon_width;
+    canvas->height = plan.dragon_height;
+    band_rows = canvas->width > 0 ? RLE_BAND_CELLS / canvas->width : 1;
+    if (band_rows < 1)
+        band_rows = 1;
+    nb_bands = (canvas->height + band_rows - 1) / band_rows;
+
+    canvas->rows = calloc(canvas->height + 1, sizeof(size_t));
+    bands = calloc(nb_bands > 0 ? nb_bands : 1, sizeof(struct rle_band));
+    if (canvas->rows == NULL || bands == NULL) {
+        printf("malloc error rle rows\n");
+        goto err;
+    }
+
+    #pragma omp parallel num_threads(nb_thread) reduction(|:err) private(b)
+    {
+        char *cells = malloc((size_t) band_rows * canvas->width);
+        if (cells == NULL) {
+            printf("malloc error rle band\n");
+            err = 1;
+        }
+
+        #pragma omp for schedule(static)
+        for (i = 0; i < nb_thread; i++)
+            band_plan_blocks(&plan, i, nb_thread);
+
+        #pragma omp for schedule(dynamic, 1)
+        for (b = 0; b < nb_bands; b++) {
+            int first = b * band_rows;
+            int last = first + band_rows < canvas->height ? first + band_rows : canvas->height;
+            struct perf_sample sample;
+            if (cells == NULL)
+                continue;
+            perf_begin(plan.perf, &sample);
+            init_canvas(0, (last - first) * canvas->width, cells, -1);
+            perf_end(plan.perf, PERF_CLEAR, &sample);
+            perf_begin(plan.perf, &sample);
+            dragon_draw_band(plan.blocks, plan.nb_blocks, plan.shift, size, plan.nb_colors,
+                    cells, canvas->width, first, last, limits);
+            err |= encode_rows(&bands[b], cells, canvas->width, last - first,
+                    canvas->rows + first + 1) < 0;
+            perf_end(plan.perf, PERF_DRAW, &sample);
+        }
+        free(cells);
+    }
+    if (err)
+        goto err;
+
+    /* row offsets from the counts, then the runs of the bands in order */
+    for (i = 0; i < canvas->height; i++)
+        canvas->rows[i + 1] += canvas->rows[i];
+    canvas->nb_runs = canvas->rows[canvas->height];
+    canvas->runs = malloc((canvas->nb_runs + 1) * sizeof(struct rle_run));
+    if (canvas->runs == NULL) {
+        printf("malloc error rle runs\n");
+        goto err;
+    }
+    for (b = 0; b < nb_bands; b++)
+        memcpy(canvas->runs + canvas->rows[b * band_rows], bands[b].runs,
+                bands[b].nb_runs * sizeof(struct rle_run));
+
+done:
+    if (bands != NULL) {
+        for (b = 0; b < nb_bands; b++)
+            FREE(bands[b].runs);
+        FREE(bands);
+    }
+    band_plan_free(&plan);
+    return ret;
+err:
+    rle_canvas_free(canvas);
+    ret = -1;
+    goto done;
+}
+
+/*
+ * Same image as scale_dragon on the cells of the runs: the colors of the
+ * runs are summed by pixel, and the rest of the cells under the pixel
+ * are white.
+ */
+int rle_canvas_render(struct rle_canvas *canvas, int start, int end, struct rgb *image,
+        int image_width, int image_height, struct palette *palette)
+{
+    int dragon_width = canvas->width;
+    int dragon_height = canvas->height;
+    int scale_x = dragon_width / image_width + 1;
+    int scale_y = dragon_height / image_height + 1;
+    int scale = (scale_x > scale_y ? scale_x : scale_y);
+    int deltaJ = (scale * image_width - dragon_width) / 2;
+    int deltaI = (scale * image_height - dragon_height) / 2;
+    struct rgb *colors = palette->colors;
+    int *sums;
+    int x, y, i;
+    size_t k;
+
+    sums = malloc(4 * image_width * sizeof(int));
+    if (sums == NULL) {
+        printf("malloc error rle render\n");
+        return -1;
+    }
+    int *red = sums;
+    int *green = sums + image_width;
+    int *blue = sums + 2 * image_width;
+    int *covered = sums + 3 * image_width;
+
+    for (y = start; y < end; y++) {
+        int i1 = y * scale - deltaI;
+        int i2 = i1 + scale;
+        if (i1 < 0) i1 = 0;
+        if (i2 > dragon_height) i2 = dragon_height;
+
+        memset(sums, 0, 4 * image_width * sizeof(int));
+        for (i = i1; i < i2; i++) {
+            for (k = canvas->rows[i]; k < canvas->rows[i + 1]; k++) {
+                const struct rle_run *run = &canvas->runs[k];
+                struct rgb color = colors[(int) run->id];
+                int c = run->start;
+                int stop = run->start + run->length;
+                /* split the run at the pixel boundaries */
+                while (c < stop) {
+                    int next;
+                    x = (c + deltaJ) / scale;
+                    next = (x + 1) * scale - deltaJ;
+                    if (next > stop)
+                        next = stop;
+                    if (x < image_width) {
+                        red[x] += (next - c) * color.r;
+                        green[x] += (next - c) * color.g;
+                        blue[x] += (next - c) * color.b;
+                        covered[x] += next - c;
+                    }
+                    c = next;
+                }
+            }
+        }
+
+        for (x = 0; x < image_width; x++) {
+            int j1 = x * scale - deltaJ, j2 = j1 + scale;
+            int index = y * image_width + x;
+            int cnt, blank;
+            if (j1 < 0) j1 = 0;
+            if (j2 > dragon_width) j2 = dragon_width;
+            cnt = (i2 > i1 && j2 > j1) ? (i2 - i1) * (j2 - j1) : 0;
+            if (cnt == 0) {
+                image[index] = white;
+                continue;
+            }
+            blank = cnt - covered[x];
+            image[index].r = (unsigned char) ((red[x]   + 255 * blank) / cnt);
+            image[index].g = (unsigned char) ((green[x] + 255 * blank) / cnt);
+            image[index].b = (unsigned char) ((blue[x]  + 255 * blank) / cnt);
+        }
+    }
+    free(sums);
+    return 0;
+}
+
+size_t rle_canvas_bytes(struct rle_canvas *canvas)
+{
+    return canvas->nb_runs * sizeof(struct rle_run) + (canvas->height + 1) * sizeof(size_t);
+}
+
+void rle_canvas_free(struct rle_canvas *canvas)
+{
+    FREE(canvas->rows);
+    FREE(canvas->runs);
+    canvas->nb_runs = 0;
+}
+
+/* rows of the image rendered by a task */
+#define RLE_RENDER_ROWS 8
+
+/*
+ * Draw the dragon of `size` segments in a run canvas and render it in
+ * `image`, with the team of the context.
+ */
+int dragon_draw_rle(struct dragon_ctx *ctx, struct rgb *image, int width, int height,
+        uint64_t size, int verbose)
+{
+    struct rle_canvas canvas;
+    struct dragon_perf *perf = dragon_ctx_perf(ctx);
+    int y, err = 0;
+
+    if (rle_canvas_draw(ctx, &canvas, size) < 0)
+        return -1;
+    if (verbose)
+        printf("rle runs=%zu bytes=%zu canvas=%zu\n", canvas.nb_runs, rle_canvas_bytes(&canvas),
+                (size_t) canvas.width * canvas.height);
+
+    #pragma omp parallel num_threads(ctx->nb_thread) reduction(|:err)
+    {
+        struct perf_sample sample;
+        perf_begin(perf, &sample);
+        #pragma omp for schedule(dynamic, 1)
+        for (y = 0; y < height; y += RLE_RENDER_ROWS)
+            err |= rle_canvas_render(&canvas, y,
+                    y + RLE_RENDER_ROWS < height ? y + RLE_RENDER_ROWS : height,
+                    image, width, height, ctx->palette) < 0;
+        perf_end(perf, PERF_RENDER, &sample);
+    }
+    rle_canvas_free(&canvas);
+    return err ? -1 : 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * dragon_rle.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_RLE_H_
+#define DRAGON_RLE_H_
+
+#include "dragon.h"
+#include "dragon_ctx.h"
+
+/* cells [start, start + length[ of a row, all of color id */
+struct rle_run {
+    int32_t start;
+    int32_t length;
+    char id;
+};
+
+/* the runs of row i are runs[rows[i]] to runs[rows[i + 1] - 1] */
+struct rle_canvas {
+    int width;
+    int height;
+    size_t *rows;
+    struct rle_run *runs;
+    size_t nb_runs;
+};
+
+int rle_canvas_draw(struct dragon_ctx *ctx, struct rle_canvas *canvas, uint64_t size);
+int rle_canvas_render(struct rle_canvas *canvas, int start, int end, struct rgb *image,
+        int image_width, int image_height, struct palette *palette);
+size_t rle_canvas_bytes(struct rle_canvas *canvas);
+void rle_canvas_free(struct rle_canvas *canvas);
+int dragon_draw_rle(struct dragon_ctx *ctx, struct rgb *image, int width, int height,
+        uint64_t size, int verbose);
+
+#endif /* DRAGON_RLE_H_ */
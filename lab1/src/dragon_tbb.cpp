@@ -11,6 +11,8 @@ extern "C" {
 #include "dragon.h"
 #include "color.h"
 #include "utils.h"
+#include "affinity.h"
+#include "dragon_ctx.h"
 }
 #include "dragon_tbb.h"
 #include "tbb/tbb.h"
@@ -19,36 +21,36 @@ extern "C" {
 using namespace std;
 using namespace tbb;
 
-static TidMap* tid = NULL;
-
 class DragonLimits {
     public:
-    piece_t pieces[NB_TILES];
+    piece_t piece;
+    struct dragon_perf *perf;
 
-    DragonLimits(){
-        for(int i =0; i< NB_TILES; i++){
-            piece_init(&pieces[i]);
-            pieces[i].orientation = tiles_orientation[i];
-        }
+    DragonLimits(struct dragon_perf *pf)
+    : perf(pf)
+    {
+        piece_init(&piece);
+        piece.orientation = tiles_orientation[0];
     }
 
-    DragonLimits(const DragonLimits& p, split){
-        for(int i =0; i< NB_TILES; i++){
-            piece_init(&pieces[i]);
-            pieces[i].orientation = tiles_orientation[i];
-        }
+    DragonLimits(const DragonLimits& p, split)
+    : perf(p.perf)
+    {
+        piece_init(&piece);
+        piece.orientation = tiles_orientation[0];
     }
 
-    void operator()(const blocked_range<int>& range){		
-        for(int i =0; i< NB_TILES; i++){
-            piece_limit(range.begin(), range.end(), &pieces[i]);
-        }
+    /* seule la tuile 0 est parcourue */
+    void operator()(const blocked_range<int>& range){
+        struct perf_sample sample;
+
+        perf_begin(perf, &sample);
+        piece_limit(range.begin(), range.end(), &piece);
+        perf_end(perf, PERF_LIMITS, &sample);
     }
 
     void join(DragonLimits& p){
-        for(int i =0; i< NB_TILES; i++){
-            piece_merge(&pieces[i], p.pieces[i], tiles_orientation[i]);
-        }
+        piece_merge(&piece, p.piece, tiles_orientation[0]);
     }
 
 };
@@ -67,18 +69,24 @@ class DragonDraw {
     }
 
     void operator()(const blocked_range<uint64_t>& range) const{
-        for(int thread = 0; thread < info.nb_thread; thread++) {
+        struct perf_sample sample;
+
+        perf_begin(info.perf, &sample);
+        for(uint64_t thread = range.begin(); thread < range.end(); thread++) {
 		    uint64_t start = thread * info.size / info.nb_thread;
 		    uint64_t end = (thread + 1) * info.size / info.nb_thread;
-            for(int tile =0; tile < NB_TILES; tile++){
-                //dragon_draw_raw(tile, range.begin(), range.end(), 
-                dragon_draw_raw(tile, start, end, 
-                                info.dragon, info.dragon_width, info.dragon_height, 
+            if (info.deterministic)
+                dragon_draw_tiles_atomic(start, end,
+                                info.dragon, info.dragon_width, info.dragon_height,
+                                info.limits, thread);
+            else
+                dragon_draw_tiles(start, end,
+                                info.dragon, info.dragon_width, info.dragon_height,
                                 info.limits, thread);
-            }
         }
+        perf_end(info.perf, PERF_DRAW, &sample);
     }
-    
+
 };
 
 class DragonRender {
@@ -93,10 +101,14 @@ class DragonRender {
     {}
 
     void operator()(const blocked_range<int>& range) const{
-        scale_dragon(range.begin(), range.end(), info.image, 
-                     info.image_width, info.image_height, 
-                     info.dragon, info.dragon_width, info.dragon_height, 
+        struct perf_sample sample;
+
+        perf_begin(info.perf, &sample);
+        scale_dragon(range.begin(), range.end(), info.image,
+                     info.image_width, info.image_height,
+                     info.dragon, info.dragon_width, info.dragon_height,
                      info.palette);
+        perf_end(info.perf, PERF_RENDER, &sample);
     }
 };
 
@@ -104,24 +116,173 @@ class DragonClear {
     public:
     char value;
     char *canvas;
+    struct dragon_perf *perf;
 
-    DragonClear(char initValue, char *initCanvas)
-    : value(initValue), canvas(initCanvas)
+    DragonClear(char initValue, char *initCanvas, struct dragon_perf *pf)
+    : value(initValue), canvas(initCanvas), perf(pf)
     {}
 
     DragonClear(const DragonClear& drgC)
     : value(drgC.value)
     , canvas(drgC.canvas)
-    {} 
+    , perf(drgC.perf)
+    {}
 
     void operator()(const blocked_range<int>& range) const{
+        struct perf_sample sample;
+
+        perf_begin(perf, &sample);
         init_canvas(range.begin(), range.end(), canvas, value);
+        perf_end(perf, PERF_CLEAR, &sample);
+    }
+};
+
+/*
+ * épingle les threads de TBB à leur entrée dans l'arène, et leur rend le
+ * masque du processus à la sortie, le thread appelant execute() compris
+ */
+class DragonPin : public task_scheduler_observer {
+    public:
+    int policy;
+
+    DragonPin(task_arena& arena, int p)
+    : task_scheduler_observer(arena), policy(p)
+    { observe(true); }
+    ~DragonPin() { observe(false); }
+
+    void on_scheduler_entry(bool) {
+        affinity_pin(policy, this_task_arena::current_thread_index());
+    }
+
+    void on_scheduler_exit(bool) {
+        affinity_reset();
+    }
+};
+
+/*
+ * Arènes du contexte, une pour les limites et une pour le dessin, qui
+ * gardent leurs threads d'un appel à l'autre. Une arène est refaite
+ * quand son nombre de workers ou son affinité change.
+ */
+enum { ARENA_LIMITS, ARENA_DRAW, NB_ARENAS };
+
+struct DragonArenas {
+    task_arena *arena[NB_ARENAS];
+    DragonPin *pin[NB_ARENAS];
+    int nb_worker[NB_ARENAS];
+    int policy[NB_ARENAS];
+};
+
+static void arenas_free(void *p)
+{
+    DragonArenas *arenas = (DragonArenas *) p;
+
+    for (int i = 0; i < NB_ARENAS; i++) {
+        delete arenas->pin[i];
+        delete arenas->arena[i];
+    }
+    delete arenas;
+}
+
+static task_arena& ctx_arena(struct dragon_ctx *ctx, int kind, int nb_worker)
+{
+    DragonArenas *arenas = (DragonArenas *) ctx->tbb;
+
+    if (arenas == NULL) {
+        arenas = new DragonArenas();
+        ctx->tbb = arenas;
+        ctx->tbb_free = arenas_free;
+    }
+    if (arenas->arena[kind] == NULL || arenas->nb_worker[kind] != nb_worker ||
+            arenas->policy[kind] != ctx->affinity) {
+        delete arenas->pin[kind];
+        delete arenas->arena[kind];
+        arenas->pin[kind] = NULL;
+        arenas->arena[kind] = new task_arena(nb_worker);
+        arenas->nb_worker[kind] = nb_worker;
+        arenas->policy[kind] = ctx->affinity;
+        if (ctx->affinity != AFFINITY_NONE)
+            arenas->pin[kind] = new DragonPin(*arenas->arena[kind], ctx->affinity);
+        ctx->stats.nb_allocs++;
+    }
+    return *arenas->arena[kind];
+}
+
+class DragonBlocks {
+    public:
+    struct band_plan *plan;
+    int nb_parts;
+
+    DragonBlocks(struct band_plan *p, int n)
+    : plan(p), nb_parts(n)
+    {}
+
+    void operator()(const blocked_range<int>& range) const{
+        for (int i = range.begin(); i < range.end(); i++)
+            band_plan_blocks(plan, i, nb_parts);
     }
 };
 
-int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread)
+/* chaque bande est effacée, dessinée et rendue par la même tâche */
+class DragonBands {
+    public:
+    struct band_plan *plan;
+    int nb_bands;
+
+    DragonBands(struct band_plan *p, int n)
+    : plan(p), nb_bands(n)
+    {}
+
+    void operator()(const blocked_range<int>& range) const{
+        for (int i = range.begin(); i < range.end(); i++)
+            band_plan_draw(plan, i, nb_bands);
+    }
+};
+
+/* bands per thread, for the load balance */
+#define BANDS_PER_THREAD 4
+
+static int dragon_draw_bands(struct dragon_ctx *ctx, char *dragon, struct rgb *image,
+        int width, int height, limits_t limits, uint64_t size, int nb_worker, int nb_chunks)
 {
-    tid = new TidMap(nb_thread);
+    struct band_plan plan;
+
+    if (band_plan_init(&plan, dragon, limits, size, ctx->nb_thread, image, width, height,
+                ctx->palette) < 0) {
+        band_plan_free(&plan);
+        return -1;
+    }
+    plan.perf = dragon_ctx_perf(ctx);
+
+    ctx_arena(ctx, ARENA_DRAW, nb_worker).execute([&] {
+        parallel_for(blocked_range<int>(0, nb_worker, 1), DragonBlocks(&plan, nb_worker));
+        parallel_for(blocked_range<int>(0, nb_worker * nb_chunks, 1),
+                DragonBands(&plan, nb_worker * nb_chunks), simple_partitioner());
+    });
+
+    band_plan_free(&plan);
+    return 0;
+}
+
+/* grain of a range split in `chunks` per worker, 1 by default */
+static int grain(int64_t len, int nb_worker, int nb_chunks)
+{
+    int64_t g;
+
+    if (nb_chunks <= 0)
+        return 1;
+    g = len / ((int64_t) nb_worker * nb_chunks);
+    return g > 0 ? g : 1;
+}
+
+int dragon_draw_tbb(struct dragon_ctx *ctx, char **canvas, struct rgb *image, int width, int height, uint64_t size)
+{
+    /* les couleurs restent nb_thread, seuls les workers sont réglés */
+    int nb_thread = ctx->nb_thread;
+    int nb_worker = ctx->tuning.draw_workers > 0 ? ctx->tuning.draw_workers : nb_thread;
+    int nb_chunks = ctx->tuning.draw_chunks;
+
+    TidMap tid(nb_thread);
 
     //TODO("dragon_draw_tbb");
     struct draw_data data;
@@ -135,12 +296,11 @@ int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height, uin
     int scale;
     int deltaJ;
     int deltaI;
-    struct palette *palette = init_palette(nb_thread);
-    if (palette == NULL)
-        return -1;
+    struct palette *palette = ctx->palette;
 
     /* 1. Calculer les limites du dragon */
-    dragon_limits_tbb(&limits, size, nb_thread);
+    memset(&limits, 0, sizeof(limits_t));
+    dragon_limits_tbb(ctx, &limits, size);
 
     dragon_width = limits.maximums.x - limits.minimums.x;
     dragon_height = limits.maximums.y - limits.minimums.y;
@@ -151,10 +311,18 @@ int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height, uin
     deltaJ = (scale * width - dragon_width) / 2;
     deltaI = (scale * height - dragon_height) / 2;
 
-    dragon = (char *) malloc(dragon_surface);
-    if (dragon == NULL) {
-        free_palette(palette);
+    /* la surface est gardée par le contexte d'un appel à l'autre */
+    dragon = dragon_ctx_canvas(ctx, dragon_surface);
+    if (dragon == NULL)
         return -1;
+
+    /* avec des threads épinglés, chaque tâche garde sa bande du dessin */
+    if (ctx->affinity != AFFINITY_NONE) {
+        if (dragon_draw_bands(ctx, dragon, image, width, height, limits, size,
+                nb_worker, nb_chunks > 0 ? nb_chunks : BANDS_PER_THREAD) < 0)
+            return -1;
+        *canvas = dragon;
+        return 0;
     }
 
     data.nb_thread = nb_thread;
@@ -170,28 +338,29 @@ int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height, uin
     data.deltaI = deltaI;
     data.deltaJ = deltaJ;
     data.palette = palette;
+    data.deterministic = ctx->deterministic;
+    data.perf = dragon_ctx_perf(ctx);
     data.tid = (int *) calloc(nb_thread, sizeof(int));
 
-    task_scheduler_init init(nb_thread);
-
-    /* 2. Initialiser la surface : DragonClear */
-    DragonClear clear(-1, dragon);
-    parallel_for(blocked_range<int>(0,dragon_surface), clear);
+    ctx_arena(ctx, ARENA_DRAW, nb_worker).execute([&] {
+        /* 2. Initialiser la surface : DragonClear */
+        DragonClear clear(-1, dragon, data.perf);
+        parallel_for(blocked_range<int>(0,dragon_surface,grain(dragon_surface, nb_worker, nb_chunks)), clear);
 
-    /* 3. Dessiner le dragon : DragonDraw */
-    DragonDraw draw(&data);
-    parallel_for(blocked_range<uint64_t>(0,nb_thread), draw);
+        /* 3. Dessiner le dragon : DragonDraw */
+        DragonDraw draw(&data);
+        parallel_for(blocked_range<uint64_t>(0,nb_thread), draw);
 
-    /* 4. Effectuer le rendu final */
-    DragonRender render(&data);
-    parallel_for(blocked_range<int>(0,height), render);
+        /* 4. Effectuer le rendu final, laissé à l'appelant sans image */
+        if (image != NULL) {
+            DragonRender render(&data);
+            parallel_for(blocked_range<int>(0,height,grain(height, nb_worker, nb_chunks)), render);
+        }
+    });
 
-    init.terminate();
-    free_palette(palette);
     FREE(data.tid);
     *canvas = dragon;
-    tid->dump();
-    delete tid;
+    tid.dump();
     return 0;
 }
 
@@ -199,23 +368,22 @@ int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height, uin
  * Calcule les limites en terme de largeur et de hauteur de
  * la forme du dragon. Requis pour allouer la matrice de dessin.
  */
-int dragon_limits_tbb(limits_t *limits, uint64_t size, int nb_thread)
+int dragon_limits_tbb(struct dragon_ctx *ctx, limits_t *limits, uint64_t size)
 {
     //TODO("dragon_limits_tbb");
-    DragonLimits lim;
+    DragonLimits lim(dragon_ctx_perf(ctx));
+    int nb_worker = ctx->tuning.limits_workers > 0 ? ctx->tuning.limits_workers : ctx->nb_thread;
+    int nb_chunks = ctx->tuning.limits_chunks;
 
     /* 1. Calculer les limites */
-    task_scheduler_init init(nb_thread);
-    //printf("%d\n", nb_thread);
-    parallel_reduce(blocked_range<int>(0,size), lim);
+    ctx_arena(ctx, ARENA_LIMITS, nb_worker).execute([&] {
+        parallel_reduce(blocked_range<int>(0,size,grain(size, nb_worker, nb_chunks)), lim);
+    });
 
-    /* La limite globale est calculée à partir des limites
-     * de chaque dragon.
+    /* La limite globale est déduite par rotation des limites
+     * de la tuile 0.
      */
-    merge_limits(&lim.pieces[0].limits, &lim.pieces[1].limits);
-    merge_limits(&lim.pieces[0].limits, &lim.pieces[2].limits);
-    merge_limits(&lim.pieces[0].limits, &lim.pieces[3].limits);
-
-    *limits = lim.pieces[0].limits;
+    *limits = lim.piece.limits;
+    merge_tiles_limits(limits, lim.piece.limits);
     return 0;
 }
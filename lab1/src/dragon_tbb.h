@@ -13,8 +13,8 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
-int dragon_draw_tbb(char **canvas, struct rgb *image, int width, int height, uint64_t size, int nb_thread);
-int dragon_limits_tbb(limits_t *limits, uint64_t size, int nb_thread);
+int dragon_draw_tbb(struct dragon_ctx *ctx, char **canvas, struct rgb *image, int width, int height, uint64_t size);
+int dragon_limits_tbb(struct dragon_ctx *ctx, limits_t *limits, uint64_t size);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,368 @@
+/*
+ * dragon_tiles.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Tile pyramid of the dragon, in the XYZ layout <dir>/<z>/<x>/<y>.ppm
+ *
+ * The deepest level has one dragon cell per pixel, and each upper level
+ * is built by averaging the four child tiles. The dragon is never drawn
+ * in a full canvas: the segments are grouped in blocks, and a tile only
+ * draws the blocks whose bounding box crosses its window.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "dragon.h"
+#include "color.h"
+#include "dragon_ctx.h"
+#include "dragon_tiles.h"
+
+struct tiles_data {
+    const char *dir;
+    int tile_size;
+    int zoom;               /* deepest level, one cell per pixel */
+    int level;              /* level of the tiles in the work queue */
+    int deltaJ;             /* offset of the dragon in the deepest level */
+    int deltaI;
+    int shift;              /* log2 of the number of segments per block */
+    int nb_colors;
+    uint64_t size;
+    uint64_t nb_blocks;     /* blocks of each tile orientation */
+    limits_t limits;
+    limits_t *blocks;
+    struct palette *palette;
+    struct rgb **cache;     /* tiles of `level`, to build the upper levels */
+    uint64_t next;          /* head of the work queue */
+    uint64_t nb_items;
+    int ret;
+};
+
+static int make_dir(const char *path)
+{
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static int write_tile(struct tiles_data *data, int z, int x, int y, struct rgb *tile)
+{
+    char *path = NULL;
+    int ret = -1;
+
+    if (asprintf(&path, "%s/%d", data->dir, z) < 0)
+        return -1;
+    if (make_dir(path) < 0)
+        goto done;
+    FREE(path);
+    if (asprintf(&path, "%s/%d/%d", data->dir, z, x) < 0)
+        return -1;
+    if (make_dir(path) < 0)
+        goto done;
+    FREE(path);
+    if (asprintf(&path, "%s/%d/%d/%d.ppm", data->dir, z, x, y) < 0)
+        return -1;
+    ret = write_img(tile, path, data->tile_size, data->tile_size);
+done:
+    FREE(path);
+    return ret;
+}
+
+/*
+ * average the tile `child` into the quadrant (qx, qy) of `parent`
+ */
+static void downsample(struct rgb *parent, struct rgb *child, int qx, int qy, int tile_size)
+{
+    int u, v;
+    int half = tile_size / 2;
+
+    for (v = 0; v < half; v++) {
+        struct rgb *row = &parent[(qy * half + v) * tile_size + qx * half];
+        struct rgb *c0 = &child[(2 * v) * tile_size];
+        struct rgb *c1 = &child[(2 * v + 1) * tile_size];
+        for (u = 0; u < half; u++) {
+            row[u].r = (c0[2 * u].r + c0[2 * u + 1].r + c1[2 * u].r + c1[2 * u + 1].r) / 4;
+            row[u].g = (c0[2 * u].g + c0[2 * u + 1].g + c1[2 * u].g + c1[2 * u + 1].g) / 4;
+            row[u].b = (c0[2 * u].b + c0[2 * u + 1].b + c1[2 * u].b + c1[2 * u + 1].b) / 4;
+        }
+    }
+}
+
+/*
+ * window of tile (z, x, y) in canvas coordinates
+ */
+static void tile_window(struct tiles_data *data, int z, int x, int y, limits_t *window)
+{
+    int64_t span = ((int64_t) data->tile_size) << (data->zoom - z);
+
+    window->minimums.x = x * span - data->deltaJ;
+    window->minimums.y = y * span - data->deltaI;
+    window->maximums.x = window->minimums.x + span;
+    window->maximums.y = window->minimums.y + span;
+}
+
+/*
+ * keep the blocks of `list` crossing `window`, return the number kept
+ */
+static uint64_t filter_blocks(struct tiles_data *data, limits_t *window,
+        uint64_t *list, uint64_t nb, uint64_t *sub)
+{
+    uint64_t i, cnt = 0;
+    xy_t *origin = &data->limits.minimums;
+
+    for (i = 0; i < nb; i++) {
+        limits_t *b = &data->blocks[list[i]];
+        if (b->minimums.x - origin->x < window->maximums.x &&
+            b->maximums.x - origin->x > window->minimums.x &&
+            b->minimums.y - origin->y < window->maximums.y &&
+            b->maximums.y - origin->y > window->minimums.y)
+            sub[cnt++] = list[i];
+    }
+    return cnt;
+}
+
+static void render_leaf(struct tiles_data *data, limits_t *window,
+        uint64_t *list, uint64_t nb, char *cells, struct rgb *tile)
+{
+    int tile_size = data->tile_size;
+    int area = tile_size * tile_size;
+    uint64_t i;
+    int k;
+    limits_t origin;
+
+    origin.minimums.x = data->limits.minimums.x + window->minimums.x;
+    origin.minimums.y = data->limits.minimums.y + window->minimums.y;
+    origin.maximums = origin.minimums;
+
+    init_canvas(0, area, cells, -1);
+    for (i = 0; i < nb; i++) {
+        uint64_t tile = list[i] / data->nb_blocks;
+        uint64_t block = list[i] % data->nb_blocks;
+        uint64_t n = block << data->shift;
+        uint64_t end = (block + 1) << data->shift;
+        if (end > data->size)
+            end = data->size;
+
+        /* split the block at color boundaries */
+        while (n < end) {
+            int m = segment_color(n, data->size, data->nb_colors);
+            uint64_t stop = (m + 1) * data->size / data->nb_colors;
+            if (stop > end)
+                stop = end;
+            dragon_draw_clip(tile, n, stop, cells, tile_size, tile_size, origin, m);
+            n = stop;
+        }
+    }
+
+    for (k = 0; k < area; k++)
+        tile[k] = cells[k] >= 0 ? data->palette->colors[(int) cells[k]] : white;
+}
+
+/*
+ * Render tile (z, x, y) and all its children, depth first. Only one
+ * child tile per level is alive at once.
+ */
+static int build_tile(struct tiles_data *data, int z, int x, int y,
+        uint64_t *list, uint64_t nb, char *cells, struct rgb *tile)
+{
+    int ret = -1;
+    int q;
+    limits_t window;
+    uint64_t *sub = NULL;
+    struct rgb *child = NULL;
+    size_t tile_bytes = sizeof(struct rgb) * data->tile_size * data->tile_size;
+
+    tile_window(data, z, x, y, &window);
+    if ((sub = malloc(sizeof(uint64_t) * (nb > 0 ? nb : 1))) == NULL)
+        goto done;
+    nb = filter_blocks(data, &window, list, nb, sub);
+
+    if (z == data->zoom) {
+        render_leaf(data, &window, sub, nb, cells, tile);
+    } else {
+        if ((child = malloc(tile_bytes)) == NULL)
+            goto done;
+        for (q = 0; q < 4; q++) {
+            int qx = q & 1, qy = q >> 1;
+            if (build_tile(data, z + 1, 2 * x + qx, 2 * y + qy, sub, nb, cells, child) < 0)
+                goto done;
+            downsample(tile, child, qx, qy, data->tile_size);
+        }
+    }
+    ret = write_tile(data, z, x, y, tile);
+done:
+    FREE(sub);
+    FREE(child);
+    return ret;
+}
+
+static void *blocks_worker(void *arg)
+{
+    struct tiles_data *data = arg;
+    uint64_t total = data->nb_blocks * NB_TILES;
+    uint64_t i;
+
+    while ((i = __sync_fetch_and_add(&data->next, 1)) < total) {
+        block_limit(i / data->nb_blocks, i % data->nb_blocks, data->shift,
+                data->size, &data->blocks[i]);
+    }
+    return NULL;
+}
+
+static void *tiles_worker(void *arg)
+{
+    struct tiles_data *data = arg;
+    uint64_t total = data->nb_blocks * NB_TILES;
+    uint64_t *list = NULL;
+    char *cells = NULL;
+    uint64_t i;
+
+    list = malloc(sizeof(uint64_t) * total);
+    cells = malloc(data->tile_size * data->tile_size);
+    if (list == NULL || cells == NULL) {
+        data->ret = -1;
+        goto done;
+    }
+    for (i = 0; i < total; i++)
+        list[i] = i;
+
+    while ((i = __sync_fetch_and_add(&data->next, 1)) < data->nb_items) {
+        int x = i % (1 << data->level);
+        int y = i / (1 << data->level);
+        if (build_tile(data, data->level, x, y, list, total, cells, data->cache[i]) < 0) {
+            data->ret = -1;
+            break;
+        }
+    }
+done:
+    FREE(list);
+    FREE(cells);
+    return NULL;
+}
+
+/* the workers of the context, sharing `data` and its work queue */
+static int run_workers(struct dragon_ctx *ctx, struct tiles_data *data, void *(*worker)(void *))
+{
+    data->next = 0;
+    return dragon_pool_run(ctx, ctx->nb_thread, worker, data, 0);
+}
+
+/*
+ * Write the tile pyramid of the dragon of `size` segments under `dir`,
+ * with the workers and colors of the context. Memory is bounded by the
+ * tiles of the work queue level, a branch of tiles per thread and the
+ * block bounding boxes.
+ */
+int dragon_tiles(struct dragon_ctx *ctx, const char *dir, int tile_size, limits_t limits,
+        uint64_t size)
+{
+    struct tiles_data data;
+    int nb_thread = ctx->nb_thread;
+    int dragon_width = limits.maximums.x - limits.minimums.x;
+    int dragon_height = limits.maximums.y - limits.minimums.y;
+    int dragon_max = dragon_width > dragon_height ? dragon_width : dragon_height;
+    size_t tile_bytes = sizeof(struct rgb) * tile_size * tile_size;
+    struct rgb **upper = NULL;
+    uint64_t i;
+    int z, ret = 0;
+
+    if (tile_size < 2 || tile_size % 2 != 0) {
+        printf("error: tile size must be even\n");
+        return -1;
+    }
+
+    memset(&data, 0, sizeof(struct tiles_data));
+    data.dir = dir;
+    data.tile_size = tile_size;
+    data.size = size;
+    data.limits = limits;
+    data.nb_colors = nb_thread;
+    while (((int64_t) tile_size << data.zoom) < dragon_max)
+        data.zoom++;
+    while (data.level < data.zoom && (1LL << (2 * data.level)) < 4 * nb_thread)
+        data.level++;
+    data.deltaJ = (((int64_t) tile_size << data.zoom) - dragon_width) / 2;
+    data.deltaI = (((int64_t) tile_size << data.zoom) - dragon_height) / 2;
+
+    /*
+     * A block of 2^2k segments spans about 2^k cells: blocks are about the
+     * size of a leaf tile, bounded in number for the largest dragons.
+     */
+    for (data.shift = 0; (1 << data.shift) < tile_size; data.shift++);
+    data.shift *= 2;
+    while ((size >> data.shift) > (1 << 20))
+        data.shift++;
+    data.nb_blocks = (size + (1LL << data.shift) - 1) >> data.shift;
+    data.nb_items = 1LL << (2 * data.level);
+
+    if (make_dir(dir) < 0)
+        return -1;
+
+    data.palette = ctx->palette;
+    data.blocks = malloc(sizeof(limits_t) * data.nb_blocks * NB_TILES);
+    data.cache = calloc(data.nb_items, sizeof(struct rgb *));
+    if (data.blocks == NULL || data.cache == NULL)
+        goto err;
+    for (i = 0; i < data.nb_items; i++) {
+        if ((data.cache[i] = malloc(tile_bytes)) == NULL)
+            goto err;
+    }
+
+    /* 1. Bounding box of each block */
+    if (run_workers(ctx, &data, blocks_worker) < 0)
+        goto err;
+
+    /* 2. Tiles from the work queue level down to the deepest level */
+    if (run_workers(ctx, &data, tiles_worker) < 0 || data.ret < 0)
+        goto err;
+
+    /* 3. Upper levels, from the cached tiles */
+    for (z = data.level - 1; z >= 0; z--) {
+        int side = 1 << z;
+        if ((upper = calloc(side * side, sizeof(struct rgb *))) == NULL)
+            goto err;
+        for (i = 0; i < (uint64_t) side * side; i++) {
+            int x = i % side, y = i / side, q;
+            if ((upper[i] = malloc(tile_bytes)) == NULL)
+                goto err;
+            for (q = 0; q < 4; q++) {
+                int qx = q & 1, qy = q >> 1;
+                downsample(upper[i], data.cache[(2 * y + qy) * 2 * side + 2 * x + qx],
+                        qx, qy, tile_size);
+            }
+            if (write_tile(&data, z, x, y, upper[i]) < 0)
+                goto err;
+        }
+        for (i = 0; i < data.nb_items; i++)
+            FREE(data.cache[i]);
+        FREE(data.cache);
+        data.cache = upper;
+        data.nb_items = side * side;
+        upper = NULL;
+    }
+
+done:
+    if (upper != NULL) {
+        for (i = 0; i < (1ULL << (2 * z)); i++)
+            FREE(upper[i]);
+        FREE(upper);
+    }
+    if (data.cache != NULL) {
+        for (i = 0; i < data.nb_items; i++)
+            FREE(data.cache[i]);
+        FREE(data.cache);
+    }
+    FREE(data.blocks);
+    return ret;
+err:
+    ret = -1;
+    goto done;
+}
@@ -0,0 +1,16 @@
+/*
+ * dragon_tiles.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_TILES_H_
+#define DRAGON_TILES_H_
+
+#include "dragon.h"
+#include "dragon_ctx.h"
+
+int dragon_tiles(struct dragon_ctx *ctx, const char *dir, int tile_size, limits_t limits,
+        uint64_t size);
+
+#endif /* DRAGON_TILES_H_ */
@@ -0,0 +1,236 @@
+/*
+ * dragon_tune.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Auto-tuner of the workers and chunks per worker of the limits and draw
+ * phases. A short grid is timed for a lib and a power, and the best
+ * settings are kept in a text cache, one line per (power range, lib):
+ *
+ *   <first power> <last power> <lib> <limits workers> <limits chunks>
+ *   <draw workers> <draw chunks>
+ *
+ * The colors of the image stay given by the number of threads, only the
+ * way the work is split changes.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dragon.h"
+#include "color.h"
+#include "dragon_ctx.h"
+#include "dragon_tune.h"
+
+/* powers sharing an entry of the cache */
+#define TUNE_POWER_RANGE 2
+/* runs of each setting, the best one is kept */
+#define TUNE_RUNS 2
+
+static const int tune_chunks[] = { 1, 4, 16 };
+
+struct tune_entry {
+    int first;
+    int last;
+    char lib[32];
+    struct dragon_tuning tuning;
+};
+
+static int tune_read(FILE *f, struct tune_entry *e)
+{
+    return fscanf(f, "%d %d %31s %d %d %d %d\n", &e->first, &e->last, e->lib,
+            &e->tuning.limits_workers, &e->tuning.limits_chunks,
+            &e->tuning.draw_workers, &e->tuning.draw_chunks) == 7;
+}
+
+static void tune_write(FILE *f, struct tune_entry *e)
+{
+    fprintf(f, "%d %d %s %d %d %d %d\n", e->first, e->last, e->lib,
+            e->tuning.limits_workers, e->tuning.limits_chunks,
+            e->tuning.draw_workers, e->tuning.draw_chunks);
+}
+
+static int tune_match(struct tune_entry *e, const char *lib, int power)
+{
+    return strcmp(e->lib, lib) == 0 && power >= e->first && power <= e->last;
+}
+
+/*
+ * return 0 if the cache has settings for lib at power
+ */
+int tune_load(const char *path, const char *lib, int power, struct dragon_tuning *tuning)
+{
+    FILE *f;
+    struct tune_entry e;
+    int ret = -1;
+
+    if ((f = fopen(path, "r")) == NULL)
+        return -1;
+    while (tune_read(f, &e)) {
+        if (tune_match(&e, lib, power)) {
+            *tuning = e.tuning;
+            ret = 0;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+/*
+ * replace the entry of lib at power in the cache by tuning
+ */
+int tune_store(const char *path, const char *lib, int power, struct dragon_tuning *tuning)
+{
+    FILE *f;
+    struct tune_entry e;
+    struct tune_entry *entries = NULL;
+    int nb = 0, i;
+    int ret = 0;
+
+    if ((f = fopen(path, "r")) != NULL) {
+        while (tune_read(f, &e)) {
+            if (tune_match(&e, lib, power))
+                continue;
+            struct tune_entry *tmp = realloc(entries, sizeof(struct tune_entry) * (nb + 1));
+            if (tmp == NULL) {
+                fclose(f);
+                goto err;
+            }
+            entries = tmp;
+            entries[nb++] = e;
+        }
+        fclose(f);
+    }
+
+    memset(&e, 0, sizeof(struct tune_entry));
+    e.first = power - power % TUNE_POWER_RANGE;
+    e.last = e.first + TUNE_POWER_RANGE - 1;
+    snprintf(e.lib, sizeof(e.lib), "%s", lib);
+    e.tuning = *tuning;
+
+    if ((f = fopen(path, "w")) == NULL) {
+        perror(path);
+        goto err;
+    }
+    for (i = 0; i < nb; i++)
+        tune_write(f, &entries[i]);
+    tune_write(f, &e);
+    fclose(f);
+done:
+    FREE(entries);
+    return ret;
+err:
+    ret = -1;
+    goto done;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double time_limits(struct dragon_ctx *ctx, dragon_limits_fn limits, uint64_t size)
+{
+    limits_t lim;
+    double best = -1, t;
+    int i;
+
+    for (i = 0; i < TUNE_RUNS; i++) {
+        memset(&lim, 0, sizeof(limits_t));
+        t = now();
+        if (limits(ctx, &lim, size) < 0)
+            return -1;
+        t = now() - t;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+static double time_draw(struct dragon_ctx *ctx, dragon_draw_fn draw, struct rgb *image,
+        int width, int height, uint64_t size)
+{
+    char *dragon = NULL;
+    double best = -1, t;
+    int i;
+
+    for (i = 0; i < TUNE_RUNS; i++) {
+        t = now();
+        if (draw(ctx, &dragon, image, width, height, size) < 0)
+            return -1;
+        t = now() - t;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+/*
+ * Time the limits and the draw of `size` segments with the defaults of
+ * the backend, then for 1, 2, 4... workers up to twice the number of
+ * CPUs and each number of chunks per worker, and keep the fastest
+ * settings in `best`. The tuning of the context is left unchanged.
+ */
+int dragon_autotune(struct dragon_ctx *ctx, dragon_draw_fn draw, dragon_limits_fn limits,
+        uint64_t size, int width, int height, int verbose, struct dragon_tuning *best)
+{
+    struct dragon_tuning saved = ctx->tuning;
+    struct rgb *image = NULL;
+    double t, best_limits = -1, best_draw = -1;
+    long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers, c, ret = 0;
+
+    if (nb_cpus < 1)
+        nb_cpus = 1;
+    memset(best, 0, sizeof(struct dragon_tuning));
+    if ((image = dragon_ctx_image(ctx, width, height)) == NULL)
+        goto err;
+
+    /* workers = 0 times the defaults of the backend, once */
+    for (workers = 0; workers <= 2 * nb_cpus; workers = workers ? workers * 2 : 1) {
+        for (c = 0; c < (int) (sizeof(tune_chunks) / sizeof(tune_chunks[0])); c++) {
+            int chunks = workers ? tune_chunks[c] : 0;
+            if (workers == 0 && c > 0)
+                break;
+            memset(&ctx->tuning, 0, sizeof(struct dragon_tuning));
+            ctx->tuning.limits_workers = workers;
+            ctx->tuning.limits_chunks = chunks;
+            ctx->tuning.draw_workers = workers;
+            ctx->tuning.draw_chunks = chunks;
+
+            if ((t = time_limits(ctx, limits, size)) < 0)
+                goto err;
+            if (verbose)
+                printf("tune limits workers=%d chunks=%d %.6f s\n", workers, chunks, t);
+            if (best_limits < 0 || t < best_limits) {
+                best_limits = t;
+                best->limits_workers = workers;
+                best->limits_chunks = chunks;
+            }
+
+            if ((t = time_draw(ctx, draw, image, width, height, size)) < 0)
+                goto err;
+            if (verbose)
+                printf("tune draw   workers=%d chunks=%d %.6f s\n", workers, chunks, t);
+            if (best_draw < 0 || t < best_draw) {
+                best_draw = t;
+                best->draw_workers = workers;
+                best->draw_chunks = chunks;
+            }
+        }
+    }
+
+done:
+    ctx->tuning = saved;
+    return ret;
+err:
+    ret = -1;
+    goto done;
+}
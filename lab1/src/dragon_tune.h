@@ -0,0 +1,18 @@
+/*
+ * dragon_tune.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef DRAGON_TUNE_H_
+#define DRAGON_TUNE_H_
+
+#include "dragon.h"
+#include "dragon_ctx.h"
+
+int tune_load(const char *path, const char *lib, int power, struct dragon_tuning *tuning);
+int tune_store(const char *path, const char *lib, int power, struct dragon_tuning *tuning);
+int dragon_autotune(struct dragon_ctx *ctx, dragon_draw_fn draw, dragon_limits_fn limits,
+        uint64_t size, int width, int height, int verbose, struct dragon_tuning *best);
+
+#endif /* DRAGON_TUNE_H_ */
@@ -19,11 +19,27 @@
 #include <error.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include "config.h"
 #include "dragon.h"
 #include "dragon_pthread.h"
 #include "dragon_tbb.h"
+#include "dragon_tiles.h"
+#include "dragon_ooc.h"
+#include "img_stream.h"
+#include "img_map.h"
+#include "affinity.h"
+#include "dragon_tune.h"
+#include "dragon_batch.h"
+#include "dragon_animate.h"
+#include "dragon_progressive.h"
+#include "dragon_rle.h"
+#include "dragon_index.h"
+#include "dragon_ctx.h"
+#ifdef HAVE_MPI
+#include "dragon_mpi.h"
+#endif
 
 /* Globals and defaults */
 #define PROGNAME "dragonizer"
@@ -33,6 +49,10 @@
 #define DEFAULT_NB_THREAD 2
 #define DEFAULT_LIB_NAME "serial"
 #define DEFAULT_IMG_PATH "dragon.ppm"
+#define DEFAULT_TILES_PATH "dragon_tiles"
+#define DEFAULT_ANIM_PATH "dragon"
+#define DEFAULT_TILE_SIZE 256
+#define DEFAULT_TUNE_PATH "dragon_tune.txt"
 #define POWER_MAX 		30
 #define CHECK_POWER 	20
 #define CHECK_NB_THREAD	8
@@ -49,23 +69,40 @@ enum thread_lib {
 	THREAD_LIB_SERIAL,
 	THREAD_LIB_PTHREAD,
 	THREAD_LIB_TBB,
+	THREAD_LIB_MPI,
 };
 
 struct command_opts {
 	const struct command_def *cmd;
 	const struct lib_def *lib;
 	char *pgm_path;
+	char *golden_path;
+	char *tune_path;
+	char *jobs_path;
+	char *perf_path;
 	int nb_thread;
 	int height;
 	int width;
 	int power;
 	int power_max;
 	int verbose;
+	int tile_size;
+	int regen;
+	uint64_t mem_budget;
+	int stream;
+	int mmap;
+	int passes;
+	int rle;
+	int autotune;
+	int deterministic;
+	int affinity;
+	int format;
 	uint64_t size;
+	struct dragon_ctx *ctx;
 };
 
-typedef int (*draw_handler)(char **, struct rgb *, int, int, uint64_t, int);
-typedef int (*limits_handler)(limits_t *, uint64_t, int);
+typedef dragon_draw_fn draw_handler;
+typedef dragon_limits_fn limits_handler;
 
 struct lib_def {
 	const char *name;
@@ -87,6 +124,12 @@ static const struct lib_def libs[] = {
 				.lib = THREAD_LIB_TBB,
 				.draw_handler = dragon_draw_tbb,
 				.limits_handler = dragon_limits_tbb },
+#ifdef HAVE_MPI
+		{ .name = "mpi",
+				.lib = THREAD_LIB_MPI,
+				.draw_handler = dragon_draw_mpi,
+				.limits_handler = dragon_limits_mpi },
+#endif
 		{ .name = NULL,
 				.lib = THREAD_LIB_NONE,
 				.draw_handler = NULL,
@@ -107,52 +150,236 @@ static void usage(void)
 	fprintf(stderr, "Usage: " PROGNAME " [OPTIONS] [COMMAND]\n");
 	fprintf(stderr, "\nOptions:\n");
 	fprintf(stderr, "  --help	this help\n");
-	fprintf(stderr, "  --cmd		command [ draw | limits | check ]\n");
+	fprintf(stderr, "  --cmd		command [ draw | limits | check | tiles | batch | animate ]\n");
 	fprintf(stderr, "  --thread	set number of threads\n");
 	fprintf(stderr, "  --lib		set the threading library to use "\
-			"[ serial | pthread | tbb ]\n");
+			"[ serial | pthread | tbb | mpi ]\n");
 	fprintf(stderr, "  --output set image path output\n");
 	fprintf(stderr, "  --height	set dragon height\n");
 	fprintf(stderr, "  --width	set dragon width\n");
 	fprintf(stderr, "  --size	set dragon size\n");
 	fprintf(stderr, "  --power  set dragon size by power\n");
 	fprintf(stderr, "  --max    compute all dragon to max power\n");
+	fprintf(stderr, "  --tile-size set tiles width and height (tiles)\n");
+	fprintf(stderr, "  --golden keep the golden results in this file, none by default (check)\n");
+	fprintf(stderr, "  --regen  recompute the golden results (check)\n");
+	fprintf(stderr, "  --deterministic draw bit identical to serial\n");
+	fprintf(stderr, "  --mem-budget draw by bands of the canvas above this size in MiB (draw, check)\n");
+	fprintf(stderr, "  --stream render and write the image by bands of rows (draw)\n");
+	fprintf(stderr, "  --mmap   render straight into the pages of the output file (draw)\n");
+	fprintf(stderr, "  --progressive draw in this many passes of doubling density, the "\
+			"output being replaced after each one, with an OpenMP team (draw)\n");
+	fprintf(stderr, "  --rle    draw in a canvas of runs of cells instead of a full canvas, "\
+			"with an OpenMP team (draw)\n");
+	fprintf(stderr, "  --affinity pin the pthread and tbb threads "\
+			"[ none | compact | scatter | smt ]\n");
+	fprintf(stderr, "  --autotune time the workers and chunks settings, and cache the best (draw, limits)\n");
+	fprintf(stderr, "  --tune-file set the autotune cache path\n");
+	fprintf(stderr, "  --jobs   set the jobs file, one \"size width height output\" "\
+			"per line (batch)\n");
+	fprintf(stderr, "  --format set the video format [ y4m | rgb ], one frame per power "\
+			"from --power to --max, - as output for stdout (animate)\n");
+	fprintf(stderr, "  --perf   count the hardware events of the limits, clear, draw and "\
+			"render phases, written as CSV to this path (- for stdout)\n");
 	fprintf(stderr, "\n");
 	exit(EXIT_FAILURE);
 }
 
+/*
+ * Settings of the workers for the lib and the largest size of the
+ * command: timed and cached with --autotune, else read from the cache.
+ * The serial and MPI libs have nothing to tune.
+ */
+static int setup_tuning(struct command_opts *opts)
+{
+	struct dragon_tuning tuning;
+	uint64_t size = opts->size;
+	int power = 0;
+
+	if (opts->lib->lib != THREAD_LIB_PTHREAD && opts->lib->lib != THREAD_LIB_TBB) {
+		if (opts->autotune)
+			printf("nothing to tune with %s\n", opts->lib->name);
+		return 0;
+	}
+	if (opts->power > 0 && opts->power_max > 0)
+		size = 1LL << opts->power_max;
+	while ((2ULL << power) <= size)
+		power++;
+
+	if (opts->autotune) {
+		if (dragon_autotune(opts->ctx, opts->lib->draw_handler, opts->lib->limits_handler, size,
+				opts->width, opts->height, opts->verbose, &tuning) < 0)
+			return -1;
+		/* the counters are for the command, not the trials */
+		perf_reset(&opts->ctx->perf);
+		if (tune_store(opts->tune_path, opts->lib->name, power, &tuning) < 0)
+			return -1;
+	} else if (tune_load(opts->tune_path, opts->lib->name, power, &tuning) < 0) {
+		return 0;
+	}
+
+	if (opts->verbose || opts->autotune)
+		printf("tuning %s power %d: limits workers=%d chunks=%d, draw workers=%d chunks=%d\n",
+				opts->lib->name, power, tuning.limits_workers, tuning.limits_chunks,
+				tuning.draw_workers, tuning.draw_chunks);
+	opts->ctx->tuning = tuning;
+	return 0;
+}
+
+/*
+ * Draw with the lib of the options, or out of core when the canvas is
+ * larger than the memory budget. The out-of-core draw leaves no canvas,
+ * the other ones leave the canvas of the context. With a stream, the
+ * image is rendered and written by bands instead of in `img`.
+ */
+static int draw_dragon(struct command_opts *opts, char **dragon, struct rgb *img, uint64_t size,
+		struct img_stream *stream)
+{
+	limits_t limits;
+	uint64_t area = 0;
+	int ret;
+
+	memset(&limits, 0, sizeof(limits_t));
+	if (opts->mem_budget > 0 || stream != NULL) {
+		if (dragon_limits_serial(opts->ctx, &limits, size) < 0)
+			return -1;
+		area = (uint64_t) (limits.maximums.x - limits.minimums.x) *
+				(limits.maximums.y - limits.minimums.y);
+	}
+	if (opts->mem_budget > 0 && area > opts->mem_budget && opts->lib->lib != THREAD_LIB_MPI) {
+		if (opts->verbose)
+			printf("canvas of %"PRIu64" bytes drawn out of core\n", area);
+		*dragon = NULL;
+		return dragon_draw_ooc(opts->ctx, img, opts->width, opts->height, limits, size,
+				opts->mem_budget, stream);
+	}
+
+	ret = dragon_ctx_draw(opts->ctx, opts->lib->draw_handler, dragon, img,
+			opts->width, opts->height, size);
+	if (ret != 0 || stream == NULL)
+		return ret;
+
+	/* without image, the backends leave the render to the stream */
+	return img_stream_render(stream, *dragon, limits.maximums.x - limits.minimums.x,
+			limits.maximums.y - limits.minimums.y, opts->ctx->palette, opts->nb_thread);
+}
+
+struct progress_out {
+	struct command_opts *opts;
+	char *tmp;
+	struct timespec start;
+};
+
+/* replace the output with the image of the pass, through a rename */
+static int progress_write(int pass, int nb_passes, struct rgb *image, int width, int height,
+		void *data)
+{
+	struct progress_out *out = data;
+	struct timespec now;
+
+	if (write_img(image, out->tmp, width, height) < 0)
+		return -1;
+	if (rename(out->tmp, out->opts->pgm_path) < 0) {
+		perror("rename");
+		return -1;
+	}
+	if (out->opts->verbose) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		printf("pass %d/%d %.3f s\n", pass + 1, nb_passes, (now.tv_sec - out->start.tv_sec) +
+				(now.tv_nsec - out->start.tv_nsec) / 1e9);
+	}
+	return 0;
+}
+
+static int draw_progressive(struct command_opts *opts, struct rgb *img)
+{
+	struct progress_out out;
+	int ret;
+
+	out.opts = opts;
+	if (asprintf(&out.tmp, "%s.tmp", opts->pgm_path) < 0)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &out.start);
+	if (opts->verbose)
+		printf("draw size=%"PRId64" passes=%d\n", opts->size, opts->passes);
+	ret = dragon_progressive(opts->ctx, img, opts->width, opts->height, opts->size,
+			opts->passes, progress_write, &out);
+	if (ret < 0)
+		unlink(out.tmp);
+	FREE(out.tmp);
+	return ret;
+}
+
 static int cmd_draw(struct command_opts *opts)
 {
 	char *dragon = NULL;
-	struct rgb *img;
+	struct rgb *img = NULL;
+	struct img_stream *stream = NULL;
+	struct img_map map;
+	int mapped = 0;
 	int ret = 0;
 
-	img = make_canvas(opts->width, opts->height);
-	if (img == NULL)
+	if (setup_tuning(opts) < 0)
 		goto err;
 
+	/* the MPI draw gathers the whole image on rank 0 */
+	if (opts->stream && opts->lib->lib != THREAD_LIB_MPI) {
+		stream = img_stream_open(opts->pgm_path, opts->width, opts->height, opts->nb_thread + 1);
+		if (stream == NULL)
+			goto err;
+	} else if (opts->mmap && opts->lib->lib != THREAD_LIB_MPI) {
+		/* the renders write the pixels of the file, there is nothing left to write */
+		if (img_map_open(&map, opts->pgm_path, opts->width, opts->height) < 0)
+			goto err;
+		mapped = 1;
+		img = map.pixels;
+	} else {
+		img = dragon_ctx_image(opts->ctx, opts->width, opts->height);
+		if (img == NULL)
+			goto err;
+	}
+
+	/* the passes write the output themselves */
+	if (opts->passes > 1) {
+		if (draw_progressive(opts, img) < 0)
+			goto err;
+		if (opts->verbose)
+			dragon_ctx_dump_stats(opts->ctx);
+		goto done;
+	}
+	if (opts->rle) {
+		if (opts->verbose)
+			printf("draw size=%"PRId64" rle\n", opts->size);
+		if (dragon_draw_rle(opts->ctx, img, opts->width, opts->height, opts->size,
+				opts->verbose) < 0)
+			goto err;
+		if (!mapped)
+			write_img(img, opts->pgm_path, opts->width, opts->height);
+		if (opts->verbose)
+			dragon_ctx_dump_stats(opts->ctx);
+		goto done;
+	}
+
 	switch (opts->lib->lib) {
 	case THREAD_LIB_SERIAL:
 	case THREAD_LIB_PTHREAD:
 	case THREAD_LIB_TBB:
+	case THREAD_LIB_MPI:
 		if (opts->power > 0 && opts->power_max > 0) {
 			int i;
 			for (i = opts->power; i <= opts->power_max; i++) {
 				uint64_t size = 1LL << i;
 				if (opts->verbose)
 					printf("draw size=%"PRId64"\n", size);
-				ret = opts->lib->draw_handler(&dragon, img, opts->width, opts->height,
-						size, opts->nb_thread);
-				if (i != opts->power_max)
-					FREE(dragon);
+				ret = draw_dragon(opts, &dragon, img, size,
+						i == opts->power_max ? stream : NULL);
 				if (ret < 0)
 					break;
 			}
 		} else {
 			if (opts->verbose)
 				printf("draw size=%"PRId64"\n", opts->size);
-			ret = opts->lib->draw_handler(&dragon, img, opts->width, opts->height, opts->size,
-				opts->nb_thread);
+			ret = draw_dragon(opts, &dragon, img, opts->size, stream);
 		}
 		break;
 	case THREAD_LIB_NONE:
@@ -160,13 +387,20 @@ static int cmd_draw(struct command_opts *opts)
 		ret = -1;
 		break;
 	}
+	if (stream != NULL && img_stream_close(stream) < 0)
+		ret = -1;
+	stream = NULL;
 	if (ret < 0)
 		goto err;
 
-	write_img(img, opts->pgm_path, opts->width, opts->height);
+	/* a positive value means the image is on another MPI rank */
+	if (ret == 0 && img != NULL && !mapped)
+		write_img(img, opts->pgm_path, opts->width, opts->height);
+	if (opts->verbose)
+		dragon_ctx_dump_stats(opts->ctx);
 done:
-	FREE(dragon);
-	FREE(img);
+	if (mapped && img_map_close(&map) < 0)
+		ret = -1;
 	return ret;
 err:
 	ret = -1;
@@ -182,24 +416,28 @@ static int cmd_limits(struct command_opts *opts)
 	limits_t limits;
 	memset(&limits, 0, sizeof(limits_t));
 
+	if (setup_tuning(opts) < 0)
+		goto err;
+
 	switch (opts->lib->lib) {
 	case THREAD_LIB_SERIAL:
 	case THREAD_LIB_PTHREAD:
 	case THREAD_LIB_TBB:
+	case THREAD_LIB_MPI:
 		if (opts->power > 0 && opts->power_max > 0) {
 			int i;
 			for (i = opts->power; i <= opts->power_max; i++) {
 				uint64_t size = 1LL << i;
 				if (opts->verbose)
 					printf("limits size=%"PRId64"\n", size);
-				ret = opts->lib->limits_handler(&limits, size, opts->nb_thread);
+				ret = dragon_ctx_limits(opts->ctx, opts->lib->limits_handler, &limits, size);
 				if (ret < 0)
 					break;
 			}
 		} else {
 			if (opts->verbose)
 				printf("limits size=%"PRId64"\n", opts->size);
-			ret = opts->lib->limits_handler(&limits, opts->size, opts->nb_thread);
+			ret = dragon_ctx_limits(opts->ctx, opts->lib->limits_handler, &limits, opts->size);
 		}
 		break;
 	case THREAD_LIB_NONE:
@@ -210,7 +448,8 @@ static int cmd_limits(struct command_opts *opts)
 	if (ret < 0)
 		goto err;
 
-	dump_limits(&limits);
+	if (ret == 0)
+		dump_limits(&limits);
 done:
 	return ret;
 err:
@@ -221,39 +460,191 @@ err:
 static const struct command_def cmd_limit_def =
 { .name = "limits", .handler = cmd_limits };
 
-static int check_limits(struct command_opts *opts)
+/*
+ * Golden results of the serial reference, one line per
+ * (size, colors, width, height) with the limits and the hash of the
+ * canvas and of the image.
+ */
+struct golden {
+	uint64_t size;
+	int nb_colors;
+	int width;
+	int height;
+	limits_t limits;
+	uint64_t canvas_hash;
+	uint64_t image_hash;
+};
+
+static const char *golden_fmt = "%"SCNu64" %d %d %d %"SCNd64" %"SCNd64" %"SCNd64" %"SCNd64
+		" %"SCNx64" %"SCNx64"\n";
+
+static int golden_match(struct golden *g, struct command_opts *opts)
 {
+	return g->size == opts->size && g->nb_colors == opts->nb_thread &&
+			g->width == opts->width && g->height == opts->height;
+}
+
+static int golden_read(FILE *f, struct golden *g)
+{
+	return fscanf(f, golden_fmt, &g->size, &g->nb_colors, &g->width, &g->height,
+			&g->limits.minimums.x, &g->limits.minimums.y,
+			&g->limits.maximums.x, &g->limits.maximums.y,
+			&g->canvas_hash, &g->image_hash) == 10;
+}
+
+static void golden_write(FILE *f, struct golden *g)
+{
+	fprintf(f, "%"PRIu64" %d %d %d %"PRId64" %"PRId64" %"PRId64" %"PRId64
+			" %016"PRIx64" %016"PRIx64"\n",
+			g->size, g->nb_colors, g->width, g->height,
+			g->limits.minimums.x, g->limits.minimums.y,
+			g->limits.maximums.x, g->limits.maximums.y,
+			g->canvas_hash, g->image_hash);
+}
+
+/*
+ * return 0 if the golden store has an entry for opts
+ */
+static int golden_load(struct command_opts *opts, struct golden *ref)
+{
+	FILE *f;
+	struct golden g;
+	int ret = -1;
+
+	if ((f = fopen(opts->golden_path, "r")) == NULL)
+		return -1;
+	while (golden_read(f, &g)) {
+		if (golden_match(&g, opts)) {
+			*ref = g;
+			ret = 0;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+/*
+ * replace the entry for opts in the golden store by ref
+ */
+static int golden_store(struct command_opts *opts, struct golden *ref)
+{
+	FILE *f;
+	struct golden g;
+	struct golden *entries = NULL;
+	int nb = 0, i;
 	int ret = 0;
+
+	if ((f = fopen(opts->golden_path, "r")) != NULL) {
+		while (golden_read(f, &g)) {
+			if (golden_match(&g, opts))
+				continue;
+			struct golden *tmp = realloc(entries, sizeof(struct golden) * (nb + 1));
+			if (tmp == NULL) {
+				fclose(f);
+				goto err;
+			}
+			entries = tmp;
+			entries[nb++] = g;
+		}
+		fclose(f);
+	}
+
+	if ((f = fopen(opts->golden_path, "w")) == NULL) {
+		perror(opts->golden_path);
+		goto err;
+	}
+	for (i = 0; i < nb; i++)
+		golden_write(f, &entries[i]);
+	golden_write(f, ref);
+	fclose(f);
+done:
+	FREE(entries);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
+static int check_limits(struct command_opts *opts, struct golden *ref, int cached)
+{
+	int ret = 0;
+	int errors = 0;
 	int i;
 	limits_t lim_expected, lim_actual;
 	memset(&lim_expected, 0, sizeof(limits_t));
 
-	if (dragon_limits_serial(&lim_expected, opts->size, opts->nb_thread) < 0) {
-		printf("Error: limits serial failed\n");
-		return -1;
+	if (cached) {
+		lim_expected = ref->limits;
+	} else {
+		if (dragon_limits_serial(opts->ctx, &lim_expected, opts->size) < 0) {
+			printf("Error: limits serial failed\n");
+			return -1;
+		}
+		ref->limits = lim_expected;
+	}
+
+	/* the limits deduced by rotation against a walk per tile */
+	memset(&lim_actual, 0, sizeof(limits_t));
+	dragon_limits_tiles(opts->ctx, &lim_actual, opts->size);
+	if (cmp_limits(&lim_expected, &lim_actual) == 0) {
+		printf("PASS %10s %10s\n", "limits", "tiles");
+	} else {
+		errors++;
+		printf("FAIL %10s %10s\n", "limits", "tiles");
+		printf("expected: "); dump_limits(&lim_expected);
+		printf("actual  : "); dump_limits(&lim_actual);
 	}
 
 	for (i = 1; libs[i].lib != THREAD_LIB_NONE; i++) {
 		memset(&lim_actual, 0, sizeof(limits_t));
 		const char *name = libs[i].name;
-		ret = libs[i].limits_handler(&lim_actual, opts->size, opts->nb_thread);
+		ret = libs[i].limits_handler(opts->ctx, &lim_actual, opts->size);
 		if (ret < 0) {
 			printf("Error executing limits with %s\n", name);
 			return -1;
 		}
+		if (ret > 0)
+			continue;
 		if (cmp_limits(&lim_expected, &lim_actual) == 0) {
 			printf("PASS %10s %10s\n", "limits", name);
 		} else {
-			ret = -1;
+			errors++;
 			printf("FAIL %10s %10s\n", "limits", name);
 			printf("expected: "); dump_limits(&lim_expected);
 			printf("actual  : "); dump_limits(&lim_actual);
 		}
 	}
-	return ret;
+	return errors ? -1 : 0;
+}
+
+/*
+ * draw the serial reference in its own context, so that its canvas
+ * outlives the draws of the libs, and check it against the golden
+ * hashes when they come from the store. Returns 1 when it differs.
+ */
+static int check_draw_serial(struct command_opts *opts, struct golden *ref, int cached,
+		struct dragon_ctx *ctx, char **drg_exp, struct rgb *img_exp, int area)
+{
+	uint64_t canvas_hash, image_hash;
+
+	if (dragon_draw_serial(ctx, drg_exp, img_exp, opts->width, opts->height, opts->size) < 0) {
+		printf("Error: draw serial failed\n");
+		return -1;
+	}
+	canvas_hash = hash_canvas(*drg_exp, area);
+	image_hash = hash_canvas(img_exp, sizeof(struct rgb) * opts->width * opts->height);
+	if (!cached) {
+		ref->canvas_hash = canvas_hash;
+		ref->image_hash = image_hash;
+	} else if (canvas_hash != ref->canvas_hash || image_hash != ref->image_hash) {
+		printf("FAIL %10s %10s differs from %s, use --regen if expected\n", "draw",
+				"serial", opts->golden_path);
+		return 1;
+	}
+	return 0;
 }
 
-static int check_draw(struct command_opts *opts)
+static int check_draw(struct command_opts *opts, struct golden *ref, int cached)
 {
 	int ret = 0;
 	int errors = 0;
@@ -266,47 +657,78 @@ static int check_draw(struct command_opts *opts)
 	char *drg_exp = NULL, *drg_act = NULL;
 	struct rgb *img_exp = NULL, *img_act = NULL;
 	char *f1 = NULL, *f2 = NULL;
+	struct canvas_diff diff;
+	struct dragon_ctx *ref_ctx = NULL;
 
+	memset(&diff, 0, sizeof(struct canvas_diff));
 	uint64_t min_size = 1LL << CHECK_POWER;
 	if (opts->size < min_size && opts->nb_thread < CHECK_NB_THREAD)
 		printf("For best results, check with power at " \
 				"least %d and thread at least %d\n", CHECK_POWER, CHECK_NB_THREAD);
 
-	if (dragon_limits_serial(&limits, opts->size, opts->nb_thread) < 0) {
-		printf("Error: limits serial failed\n");
-		goto err;
-	}
-
+	limits = ref->limits;
 	dragon_width = limits.maximums.x - limits.minimums.x;
 	dragon_height = limits.maximums.y - limits.minimums.y;
 	area = dragon_width * dragon_height;
-	threshold = opts->nb_thread * 2 * 4;
+	/* concurrent writes may leave a few cells to another thread */
+	threshold = opts->deterministic ? 0 : opts->nb_thread * 2 * 4;
 
 	img_exp = make_canvas(opts->width, opts->height);
 	img_act = make_canvas(opts->width, opts->height);
-	if (img_exp == NULL || img_act == NULL)
+	ref_ctx = dragon_ctx_create(opts->nb_thread);
+	if (img_exp == NULL || img_act == NULL || ref_ctx == NULL)
 		goto err;
 
-	if (dragon_draw_serial(&drg_exp, img_exp, opts->width, opts->height, opts->size, opts->nb_thread) < 0) {
-		printf("Error: draw serial failed\n");
+	/* with golden hashes, the serial reference is only drawn on mismatch */
+	if (!cached && check_draw_serial(opts, ref, cached, ref_ctx, &drg_exp, img_exp, area) < 0)
 		goto err;
-	}
 
 	char *fmt = "%s %10s %10s threshold=%d gap=%d (%.3f%%)\n";
 	for (i = 1; libs[i].lib != THREAD_LIB_NONE; i++) {
 		const char *name = libs[i].name;
-		ret = libs[i].draw_handler(&drg_act, img_act, opts->width, opts->height, opts->size, opts->nb_thread);
+		ret = libs[i].draw_handler(opts->ctx, &drg_act, img_act, opts->width, opts->height, opts->size);
 		if (ret < 0) {
 			printf("Error executing draw with %s\n", name);
 			goto err;
 		}
-		int gap = cmp_canvas(drg_exp, drg_act, dragon_width, dragon_height, opts->verbose);
+		if (ret > 0) {
+			ret = 0;
+			continue;
+		}
+		/* distributed backends have no canvas, only the image is checked */
+		if (drg_act == NULL) {
+			if (hash_canvas(img_act, sizeof(struct rgb) * opts->width * opts->height) == ref->image_hash) {
+				printf(fmt, "PASS", "draw", name, threshold, 0, 0.0);
+				continue;
+			}
+			errors++;
+			printf("FAIL %10s %10s image differs\n", "draw", name);
+			continue;
+		}
+		if (hash_canvas(drg_act, area) == ref->canvas_hash &&
+				hash_canvas(img_act, sizeof(struct rgb) * opts->width * opts->height) == ref->image_hash) {
+			printf(fmt, "PASS", "draw", name, threshold, 0, 0.0);
+			continue;
+		}
+		if (drg_exp == NULL) {
+			int differs = check_draw_serial(opts, ref, cached, ref_ctx, &drg_exp, img_exp, area);
+			if (differs < 0)
+				goto err;
+			errors += differs;
+		}
+		if (canvas_diff_init(&diff, opts->nb_thread) < 0)
+			goto err;
+		int gap = -1;
+		if (cmp_canvas_report(drg_exp, drg_act, dragon_width, dragon_height,
+				threshold > 0 ? threshold : 1, opts->verbose, &diff) == 0)
+			gap = diff.count;
 		float gap_f = gap * 100 / ((float) area);
-		if (gap < threshold && gap >= 0) {
+		if ((gap < threshold || gap == 0) && gap >= 0) {
 			printf(fmt, "PASS", "draw", name, threshold, gap, gap_f);
 		} else {
 			errors++;
 			printf(fmt, "FAIL", "draw", name, threshold, gap, gap_f);
+			dump_canvas_diff(&diff);
 			if (asprintf(&f1, "dragon_check_failed_serial.ppm") < 0)
 				goto err;
 			if (asprintf(&f2, "dragon_check_failed_%s.ppm", name) < 0)
@@ -320,14 +742,29 @@ static int check_draw(struct command_opts *opts)
 			FREE(f1);
 			FREE(f2);
 		}
-		FREE(drg_act);
+		canvas_diff_free(&diff);
+	}
+
+	/* the out-of-core draw renders the same image as the serial draw */
+	if (opts->mem_budget > 0) {
+		if (dragon_draw_ooc(opts->ctx, img_act, opts->width, opts->height, limits,
+				opts->size, opts->mem_budget, NULL) < 0) {
+			printf("Error executing draw out of core\n");
+			goto err;
+		}
+		if (hash_canvas(img_act, sizeof(struct rgb) * opts->width * opts->height) == ref->image_hash) {
+			printf(fmt, "PASS", "draw", "ooc", 0, 0, 0.0);
+		} else {
+			errors++;
+			printf("FAIL %10s %10s image differs\n", "draw", "ooc");
+		}
 	}
 
 done:
+	canvas_diff_free(&diff);
 	FREE(img_exp);
 	FREE(img_act);
-	FREE(drg_exp);
-	FREE(drg_act);
+	dragon_ctx_destroy(ref_ctx);
 	FREE(f1);
 	FREE(f2);
 	if (errors != 0)
@@ -338,19 +775,297 @@ err:
 	goto done;
 }
 
+/* dragons of the index check, shift 0 letting the index choose its leaves */
+static const struct index_case {
+	uint64_t size;
+	int shift;
+} index_cases[] = {
+	{ 1, 0 }, { 7, 0 }, { 1000, 0 }, { 65536, 0 }, { 65536, 3 }, { 100003, 1 },
+};
+#define CHECK_INDEX_CASES (sizeof(index_cases) / sizeof(index_cases[0]))
+#define CHECK_INDEX_RANDOM 64
+#define CHECK_INDEX_RECTS (CHECK_INDEX_RANDOM + 10)
+/* segments after which the query is stopped */
+#define CHECK_INDEX_STOP 2
+
+struct index_found {
+	limits_t rect;
+	int64_t count;
+	int64_t stop;
+	int64_t last[NB_TILES];
+	int errors;
+};
+
+/* each segment once per tile, in order, and in the rectangle */
+static int index_found_check(uint64_t tile, uint64_t segment, void *data)
+{
+	struct index_found *f = data;
+	xy_t position = compute_position(tile, segment);
+	xy_t orientation = compute_orientation(tile, segment);
+	int64_t x = (2 * position.x + orientation.x) >> 1;
+	int64_t y = (2 * position.y + orientation.y) >> 1;
+
+	if ((int64_t) segment <= f->last[tile] ||
+		x < f->rect.minimums.x || x >= f->rect.maximums.x ||
+		y < f->rect.minimums.y || y >= f->rect.maximums.y)
+		f->errors++;
+	f->last[tile] = segment;
+	f->count++;
+	return f->stop > 0 && f->count >= f->stop;
+}
+
+/*
+ * rectangles of the check within and around `box`: the box and one cell
+ * more, its edge rows and columns, its corners, then random points and
+ * rectangles
+ */
+static void index_rects(limits_t box, limits_t *rects)
+{
+	int64_t width = box.maximums.x - box.minimums.x;
+	int64_t height = box.maximums.y - box.minimums.y;
+	int k, n = 0;
+
+	rects[n++] = box;
+	rects[n] = box;
+	rects[n].minimums.x--; rects[n].minimums.y--;
+	rects[n].maximums.x++; rects[n].maximums.y++;
+	n++;
+	rects[n] = box; rects[n++].maximums.y = box.minimums.y + 1;
+	rects[n] = box; rects[n++].minimums.y = box.maximums.y - 1;
+	rects[n] = box; rects[n++].maximums.x = box.minimums.x + 1;
+	rects[n] = box; rects[n++].minimums.x = box.maximums.x - 1;
+	for (k = 0; k < 4; k++, n++) {
+		rects[n].minimums.x = k & 1 ? box.maximums.x - 1 : box.minimums.x;
+		rects[n].minimums.y = k & 2 ? box.maximums.y - 1 : box.minimums.y;
+		rects[n].maximums.x = rects[n].minimums.x + 1;
+		rects[n].maximums.y = rects[n].minimums.y + 1;
+	}
+	for (k = 0; k < CHECK_INDEX_RANDOM; k++, n++) {
+		uint64_t h = (k + 1) * 0x9e3779b97f4a7c15ULL;
+		rects[n].minimums.x = box.minimums.x + (int64_t) ((h >> 32) % width);
+		rects[n].minimums.y = box.minimums.y + (int64_t) ((h & 0xffffffff) % height);
+		/* half points, half rectangles up to a quarter of the box */
+		rects[n].maximums.x = rects[n].minimums.x + (k & 1 ? 1 + (int64_t) (h >> 48) % (width / 4 + 1) : 1);
+		rects[n].maximums.y = rects[n].minimums.y + (k & 1 ? 1 + (int64_t) (h >> 8 & 0xffff) % (height / 4 + 1) : 1);
+	}
+}
+
+/*
+ * the segments found by dragon_index_rect against a walk of all the
+ * segments, from their own position and orientation
+ */
+static int check_index(struct command_opts *opts)
+{
+	limits_t rects[CHECK_INDEX_RECTS];
+	int64_t expected[CHECK_INDEX_RECTS];
+	struct dragon_index index;
+	struct index_found f;
+	limits_t box;
+	uint64_t c, tile, n;
+	int r, errors, failures = 0;
+
+	for (c = 0; c < CHECK_INDEX_CASES; c++) {
+		const struct index_case *ic = &index_cases[c];
+
+		memset(&box, 0, sizeof(limits_t));
+		if (dragon_limits_serial(opts->ctx, &box, ic->size) < 0 ||
+			dragon_index_build(&index, ic->size, ic->shift) < 0) {
+			printf("Error: index of %"PRIu64" segments failed\n", ic->size);
+			return -1;
+		}
+		index_rects(box, rects);
+		memset(expected, 0, sizeof(expected));
+		for (tile = 0; tile < NB_TILES; tile++) {
+			for (n = 0; n < ic->size; n++) {
+				xy_t position = compute_position(tile, n);
+				xy_t orientation = compute_orientation(tile, n);
+				int64_t x = (2 * position.x + orientation.x) >> 1;
+				int64_t y = (2 * position.y + orientation.y) >> 1;
+				for (r = 0; r < CHECK_INDEX_RECTS; r++) {
+					if (x >= rects[r].minimums.x && x < rects[r].maximums.x &&
+						y >= rects[r].minimums.y && y < rects[r].maximums.y)
+						expected[r]++;
+				}
+			}
+		}
+
+		errors = 0;
+		for (r = 0; r < CHECK_INDEX_RECTS; r++) {
+			memset(&f, 0, sizeof(struct index_found));
+			f.rect = rects[r];
+			for (tile = 0; tile < NB_TILES; tile++)
+				f.last[tile] = -1;
+			if (dragon_index_rect(&index, rects[r], NULL, NULL) != expected[r] ||
+				dragon_index_rect(&index, rects[r], index_found_check, &f) != expected[r] ||
+				f.count != expected[r] || f.errors != 0) {
+				errors++;
+				printf("rect [%"PRId64", %"PRId64"[ x [%"PRId64", %"PRId64"[: expected %"PRId64" segments\n",
+						rects[r].minimums.x, rects[r].maximums.x,
+						rects[r].minimums.y, rects[r].maximums.y, expected[r]);
+				continue;
+			}
+			/* a query stops at the segment the callback stops at */
+			memset(&f, 0, sizeof(struct index_found));
+			f.rect = rects[r];
+			f.stop = CHECK_INDEX_STOP;
+			for (tile = 0; tile < NB_TILES; tile++)
+				f.last[tile] = -1;
+			if (dragon_index_rect(&index, rects[r], index_found_check, &f) !=
+				(expected[r] < CHECK_INDEX_STOP ? expected[r] : CHECK_INDEX_STOP))
+				errors++;
+		}
+		/* rects[6] is the cell at the minimums, see index_rects */
+		if (dragon_index_point(&index, box.minimums.x, box.minimums.y, NULL, NULL) != expected[6])
+			errors++;
+		dragon_index_free(&index);
+
+		printf("%s %10s size=%"PRIu64" shift=%d\n", errors ? "FAIL" : "PASS", "index",
+				ic->size, ic->shift);
+		if (errors)
+			failures++;
+	}
+	return failures ? -1 : 0;
+}
+
 static int cmd_check(struct command_opts *opts)
 {
 	int ret = 0;
-	if (check_limits(opts) < 0)
+	int cached;
+	struct golden ref;
+
+	memset(&ref, 0, sizeof(struct golden));
+	cached = opts->golden_path != NULL && !opts->regen && golden_load(opts, &ref) == 0;
+	if (opts->verbose && opts->golden_path != NULL)
+		printf("golden reference %s %s\n", opts->golden_path,
+				cached ? "found" : "computed");
+
+	if (check_limits(opts, &ref, cached) < 0)
 		ret = -1;
-	if (check_draw(opts) < 0)
+	if (check_draw(opts, &ref, cached) < 0)
 		ret = -1;
+	if (check_index(opts) < 0)
+		ret = -1;
+
+	if (opts->golden_path != NULL && !cached && ret == 0) {
+		ref.size = opts->size;
+		ref.nb_colors = opts->nb_thread;
+		ref.width = opts->width;
+		ref.height = opts->height;
+		if (golden_store(opts, &ref) < 0)
+			ret = -1;
+	}
 	return ret;
 }
 
 static const struct command_def cmd_check_def =
 { .name = "check", .handler = cmd_check };
 
+static int cmd_tiles(struct command_opts *opts)
+{
+	int ret = 0;
+	char *dir = opts->pgm_path;
+	limits_t limits;
+	memset(&limits, 0, sizeof(limits_t));
+
+	/* the output is a directory, the default image name does not fit */
+	if (strcmp(dir, DEFAULT_IMG_PATH) == 0)
+		dir = DEFAULT_TILES_PATH;
+
+	if (opts->lib->limits_handler(opts->ctx, &limits, opts->size) < 0) {
+		printf("Error: limits %s failed\n", opts->lib->name);
+		return -1;
+	}
+
+	if (opts->verbose)
+		printf("tiles size=%"PRId64" tile_size=%d output=%s\n",
+				opts->size, opts->tile_size, dir);
+
+	ret = dragon_tiles(opts->ctx, dir, opts->tile_size, limits, opts->size);
+	return ret;
+}
+
+static const struct command_def cmd_tiles_def =
+{ .name = "tiles", .handler = cmd_tiles };
+
+/*
+ * Draw the jobs of --jobs in one process. The draws use an OpenMP team
+ * of --thread threads instead of --lib, the colors being the same.
+ */
+static int cmd_batch(struct command_opts *opts)
+{
+	struct batch_job *jobs = NULL;
+	int nb_jobs = 0, i, ret = 0;
+
+	if (opts->jobs_path == NULL) {
+		printf("Error: batch needs a jobs file (--jobs)\n");
+		return -1;
+	}
+	if (batch_load(opts->jobs_path, &jobs, &nb_jobs) < 0)
+		goto err;
+	for (i = 0; i < nb_jobs; i++) {
+		if (jobs[i].size >= (1ULL << POWER_MAX)) {
+			printf("Error: job %d size must be lower than %"PRIu64"\n", i, (uint64_t) 1 << POWER_MAX);
+			goto err;
+		}
+	}
+	if (opts->verbose)
+		printf("batch of %d jobs\n", nb_jobs);
+	ret = dragon_batch(opts->ctx, jobs, nb_jobs, opts->verbose);
+	if (opts->verbose)
+		dragon_ctx_dump_stats(opts->ctx);
+done:
+	batch_free(jobs, nb_jobs);
+	return ret;
+err:
+	ret = -1;
+	goto done;
+}
+
+static const struct command_def cmd_batch_def =
+{ .name = "batch", .handler = cmd_batch };
+
+/* the messages, on stderr when the output is the standard output */
+static FILE *msg_out(struct command_opts *opts)
+{
+	return opts->pgm_path != NULL && strcmp(opts->pgm_path, "-") == 0 ? stderr : stdout;
+}
+
+/*
+ * Video of the growth of the dragon, one frame per power from --power
+ * (1 by default) to --max. The draws use an OpenMP team of --thread
+ * threads instead of --lib, the colors being the generations.
+ */
+static int cmd_animate(struct command_opts *opts)
+{
+	char *path = opts->pgm_path;
+	char *tmp = NULL;
+	int first = opts->power > 0 ? opts->power : 1;
+	int last = opts->power_max > 0 ? opts->power_max : first;
+	int ret;
+
+	if (last < first || last >= POWER_MAX) {
+		fprintf(msg_out(opts), "Error: animate powers must be in the range [%d,%d[\n",
+				first, POWER_MAX);
+		return -1;
+	}
+	/* the default image name does not fit the video */
+	if (strcmp(path, DEFAULT_IMG_PATH) == 0) {
+		if (asprintf(&tmp, "%s.%s", DEFAULT_ANIM_PATH, anim_format_name(opts->format)) < 0)
+			return -1;
+		path = tmp;
+	}
+	if (opts->verbose)
+		fprintf(stderr, "animate powers %d to %d %s output=%s\n", first, last,
+				anim_format_name(opts->format), path);
+	ret = dragon_animate(opts->ctx, path, opts->format, opts->width, opts->height,
+			first, last, opts->verbose);
+	FREE(tmp);
+	return ret;
+}
+
+static const struct command_def cmd_animate_def =
+{ .name = "animate", .handler = cmd_animate };
+
 static const struct command_def cmd_def_last =
 { .name = NULL, .handler = NULL };
 
@@ -358,6 +1073,9 @@ static const struct command_def * const commands[] = {
 		&cmd_draw_def,
 		&cmd_limit_def,
 		&cmd_check_def,
+		&cmd_tiles_def,
+		&cmd_batch_def,
+		&cmd_animate_def,
 		&cmd_def_last
 };
 
@@ -381,18 +1099,29 @@ static const struct lib_def *lookup_lib(const char *name)
 	return NULL;
 }
 
-static void dump_opts(struct command_opts *opts)
+static void dump_opts(FILE *out, struct command_opts *opts)
 {
-	printf("%10s %s\n", "option", "value");
-	printf("%10s %s\n", "cmd", opts->cmd->name);
-	printf("%10s %s\n", "lib", opts->lib->name);
-	printf("%10s %s\n", "output", opts->pgm_path);
-	printf("%10s %d\n", "thread", opts->nb_thread);
-	printf("%10s %d\n", "height", opts->height);
-	printf("%10s %d\n", "width", opts->width);
-	printf("%10s %" PRId64 "\n", "size", opts->size);
-	printf("%10s %d\n", "power", opts->power);
-	printf("%10s %d\n", "max", opts->power_max);
+	fprintf(out, "%10s %s\n", "option", "value");
+	fprintf(out, "%10s %s\n", "cmd", opts->cmd->name);
+	fprintf(out, "%10s %s\n", "lib", opts->lib->name);
+	fprintf(out, "%10s %s\n", "output", opts->pgm_path);
+	fprintf(out, "%10s %d\n", "thread", opts->nb_thread);
+	fprintf(out, "%10s %d\n", "height", opts->height);
+	fprintf(out, "%10s %d\n", "width", opts->width);
+	fprintf(out, "%10s %" PRId64 "\n", "size", opts->size);
+	fprintf(out, "%10s %d\n", "power", opts->power);
+	fprintf(out, "%10s %d\n", "max", opts->power_max);
+	fprintf(out, "%10s %d\n", "tile-size", opts->tile_size);
+	fprintf(out, "%10s %d\n", "deterministic", opts->deterministic);
+	fprintf(out, "%10s %"PRIu64"\n", "mem-budget", opts->mem_budget >> 20);
+	fprintf(out, "%10s %d\n", "stream", opts->stream);
+	fprintf(out, "%10s %d\n", "mmap", opts->mmap);
+	fprintf(out, "%10s %d\n", "progressive", opts->passes);
+	fprintf(out, "%10s %d\n", "rle", opts->rle);
+	fprintf(out, "%10s %s\n", "affinity", affinity_name(opts->affinity));
+	fprintf(out, "%10s %d\n", "autotune", opts->autotune);
+	fprintf(out, "%10s %s\n", "format", anim_format_name(opts->format));
+	fprintf(out, "%10s %s\n", "perf", opts->perf_path != NULL ? opts->perf_path : "none");
 }
 
 void default_int_value(int *value, int def)
@@ -419,12 +1148,27 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 			{ "power",	 1, 0, 'p' },
 			{ "max",	 1, 0, 'm' },
 			{ "verbose", 0, 0, 'v' },
+			{ "tile-size", 1, 0, 'T' },
+			{ "golden",  1, 0, 'g' },
+			{ "regen",   0, 0, 'r' },
+			{ "deterministic", 0, 0, 'd' },
+			{ "mem-budget", 1, 0, 'M' },
+			{ "stream",  0, 0, 'S' },
+			{ "mmap",    0, 0, 'W' },
+			{ "progressive", 1, 0, 'R' },
+			{ "rle",     0, 0, 'E' },
+			{ "affinity", 1, 0, 'A' },
+			{ "autotune", 0, 0, 'a' },
+			{ "tune-file", 1, 0, 'u' },
+			{ "jobs",    1, 0, 'j' },
+			{ "perf",    1, 0, 'P' },
+			{ "format",  1, 0, 'F' },
 			{ 0, 0, 0, 0}
 	};
 
 	memset(opts, 0, sizeof(struct command_opts));
 
-	while ((opt = getopt_long(argc, argv, "hvx:y:s:c:t:l:p:o:m:", options, &idx)) != -1) {
+	while ((opt = getopt_long(argc, argv, "hvrdSWEax:y:s:c:t:l:p:o:m:T:g:M:A:u:j:P:F:R:", options, &idx)) != -1) {
 		switch(opt) {
 		case 'c':
 			opts->cmd = lookup_cmd(optarg);
@@ -464,6 +1208,63 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 		case 'v':
 			opts->verbose = 1;
 			break;
+		case 'T':
+			opts->tile_size = atoi(optarg);
+			break;
+		case 'g':
+			if (asprintf(&opts->golden_path, "%s", optarg) < 0)
+				goto err;
+			break;
+		case 'r':
+			opts->regen = 1;
+			break;
+		case 'd':
+			opts->deterministic = 1;
+			break;
+		case 'M':
+			opts->mem_budget = strtoull(optarg, NULL, 10) << 20;
+			break;
+		case 'S':
+			opts->stream = 1;
+			break;
+		case 'W':
+			opts->mmap = 1;
+			break;
+		case 'R':
+			opts->passes = atoi(optarg);
+			break;
+		case 'E':
+			opts->rle = 1;
+			break;
+		case 'a':
+			opts->autotune = 1;
+			break;
+		case 'u':
+			if (asprintf(&opts->tune_path, "%s", optarg) < 0)
+				goto err;
+			break;
+		case 'j':
+			if (asprintf(&opts->jobs_path, "%s", optarg) < 0)
+				goto err;
+			break;
+		case 'F':
+			opts->format = anim_format_parse(optarg);
+			if (opts->format < 0) {
+				printf("unknown format %s\n", optarg);
+				ret = -1;
+			}
+			break;
+		case 'P':
+			if (asprintf(&opts->perf_path, "%s", optarg) < 0)
+				goto err;
+			break;
+		case 'A':
+			opts->affinity = affinity_parse(optarg);
+			if (opts->affinity < 0) {
+				printf("unknown affinity %s\n", optarg);
+				ret = -1;
+			}
+			break;
 		default:
 			printf("unknown option %c\n", opt);
 			ret = -1;
@@ -478,6 +1279,9 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 	if (opts->pgm_path == NULL)
 		opts->pgm_path = DEFAULT_IMG_PATH;
 
+	if (opts->tune_path == NULL)
+		opts->tune_path = DEFAULT_TUNE_PATH;
+
 	if (opts->size > (1LL << POWER_MAX)) {
 		printf("Error: size must be lower or equals to %"PRId64"\n", opts->size);
 		ret = -1;
@@ -508,6 +1312,29 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 	default_int_value(&opts->height, DEFAULT_HEIGHT);
 	default_int_value(&opts->width, DEFAULT_WIDTH);
 	default_int_value(&opts->nb_thread, DEFAULT_NB_THREAD);
+	default_int_value(&opts->tile_size, DEFAULT_TILE_SIZE);
+
+	if (opts->stream && opts->mmap) {
+		printf("Error: --stream and --mmap are exclusive\n");
+		ret = -1;
+	}
+
+	if (opts->passes > 1 && (opts->stream || opts->mmap || opts->mem_budget > 0 ||
+			opts->power_max > 0 || opts->lib->lib == THREAD_LIB_MPI)) {
+		printf("Error: --progressive draws one size in memory, without --stream, --mmap, "\
+				"--mem-budget, --max or mpi\n");
+		ret = -1;
+	}
+	if (opts->rle && (opts->stream || opts->mem_budget > 0 || opts->passes > 1 ||
+			opts->power_max > 0 || opts->lib->lib == THREAD_LIB_MPI)) {
+		printf("Error: --rle draws one size in memory, without --stream, --mem-budget, "\
+				"--progressive, --max or mpi\n");
+		ret = -1;
+	}
+	if (opts->passes < 0 || opts->passes > POWER_MAX) {
+		printf("Error: progressive passes out of range [0,%d]\n", POWER_MAX);
+		ret = -1;
+	}
 
 	if (opts->width == 0 || opts->height == 0) {
 		fprintf(stderr, "argument error: height and width must be greater than 0\n");
@@ -515,7 +1342,7 @@ static int parse_opts(int argc, char **argv, struct command_opts *opts)
 	}
 
 	if (opts->verbose)
-		dump_opts(opts);
+		dump_opts(msg_out(opts), opts);
 
 done:
 	return ret;
@@ -524,9 +1351,26 @@ err:
 	goto done;
 }
 
+/* totals of the counted phases, as CSV */
+static int write_perf(struct command_opts *opts)
+{
+	FILE *f = stdout;
+	int ret;
+
+	if (strcmp(opts->perf_path, "-") != 0 && (f = fopen(opts->perf_path, "w")) == NULL) {
+		perror(opts->perf_path);
+		return -1;
+	}
+	ret = perf_dump_csv(&opts->ctx->perf, f);
+	if (f != stdout && fclose(f) != 0)
+		ret = -1;
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
 	struct command_opts opts;
+	int ret;
 	if (parse_opts(argc, argv, &opts) < 0) {
 		printf("Error while parsing arguments\n");
 		usage();
@@ -537,14 +1381,29 @@ int main(int argc, char **argv)
 		usage();
 	}
 
-	if ((opts.cmd->handler(&opts)) < 0) {
-		printf("Error while executing command %s\n", opts.cmd->name);
+	/* state of the draws, shared by the steps of the command */
+	if ((opts.ctx = dragon_ctx_create(opts.nb_thread)) == NULL) {
+		printf("Error while creating the dragon context\n");
+		goto err;
+	}
+	opts.ctx->deterministic = opts.deterministic;
+	opts.ctx->affinity = opts.affinity;
+	opts.ctx->perf.enabled = opts.perf_path != NULL;
+
+	if ((ret = opts.cmd->handler(&opts)) < 0) {
+		fprintf(msg_out(&opts), "Error while executing command %s\n", opts.cmd->name);
 		goto err;
 	}
 
+	/* with MPI, the counters of rank 0 only */
+	if (ret == 0 && opts.perf_path != NULL && write_perf(&opts) < 0)
+		goto err;
+
+	dragon_ctx_destroy(opts.ctx);
 	return EXIT_SUCCESS;
 
 	err:
+	dragon_ctx_destroy(opts.ctx);
 	exit(EXIT_FAILURE);
 }
 
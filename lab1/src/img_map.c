@@ -0,0 +1,77 @@
+/*
+ * img_map.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * PPM output mapped in memory: the file is created at its final size
+ * with its header, and its pixels are given to the renders as the
+ * image, so that the threads write the pixels straight into the pages
+ * of the file. There is then no image buffer to copy into stdio, and no
+ * serial write after the render.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "color.h"
+#include "img_map.h"
+
+int img_map_open(struct img_map *map, const char *path, int width, int height)
+{
+    char header[64];
+    int len;
+
+    memset(map, 0, sizeof(struct img_map));
+    map->fd = -1;
+    map->base = MAP_FAILED;
+    len = snprintf(header, sizeof(header), "P6\n%d %d\n%d\n", width, height, 255);
+    map->len = len + sizeof(struct rgb) * (size_t) width * height;
+
+    if ((map->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        perror(path);
+        goto err;
+    }
+    /*
+     * The blocks are reserved now, so that a full disk fails here and not
+     * with a SIGBUS in a render; the size is only set where reserving is
+     * not supported.
+     */
+    if ((errno = posix_fallocate(map->fd, 0, map->len)) != 0 &&
+        (errno == ENOSPC || ftruncate(map->fd, map->len) < 0)) {
+        perror(path);
+        goto err;
+    }
+    map->base = mmap(NULL, map->len, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+    if (map->base == MAP_FAILED) {
+        perror("mmap");
+        goto err;
+    }
+    memcpy(map->base, header, len);
+    map->pixels = (struct rgb *) ((char *) map->base + len);
+    return 0;
+err:
+    img_map_close(map);
+    return -1;
+}
+
+/* unmap and close, the pixels being written back by the kernel */
+int img_map_close(struct img_map *map)
+{
+    int ret = 0;
+
+    if (map->base != MAP_FAILED && map->base != NULL && munmap(map->base, map->len) < 0)
+        ret = -1;
+    if (map->fd >= 0 && close(map->fd) < 0)
+        ret = -1;
+    map->base = MAP_FAILED;
+    map->fd = -1;
+    map->pixels = NULL;
+    return ret;
+}
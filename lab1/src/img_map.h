@@ -0,0 +1,24 @@
+/*
+ * img_map.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef IMG_MAP_H_
+#define IMG_MAP_H_
+
+#include <stddef.h>
+#include "color.h"
+
+/* PPM file whose pixels are mapped in memory */
+struct img_map {
+    int fd;
+    void *base;
+    size_t len;
+    struct rgb *pixels;     /* width x height pixels, after the header */
+};
+
+int img_map_open(struct img_map *map, const char *path, int width, int height);
+int img_map_close(struct img_map *map);
+
+#endif /* IMG_MAP_H_ */
@@ -0,0 +1,287 @@
+/*
+ * img_stream.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * PPM output written by bands of rows, so that the image never sits in
+ * memory as a whole.
+ *
+ * Producers take a buffer of `rows` image rows, render a band in it and
+ * hand it to the writer thread, which writes the bands in row order and
+ * gives their buffers back. Rendering then overlaps with writing, and
+ * the output memory is bounded by the `nb_buffers` buffers.
+ *
+ * A producer must take its buffer before choosing its band: the band
+ * the writer waits for then always owns a buffer, and the bands queued
+ * after it cannot hold all the buffers.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "dragon.h"
+#include "color.h"
+#include "img_stream.h"
+
+struct stream_band {
+    struct rgb *buffer;
+    int start;
+    int end;
+};
+
+struct img_stream {
+    FILE *file;
+    int width;
+    int height;
+    int rows;               /* image rows per buffer */
+    int nb_buffers;
+    struct rgb **buffers;
+    struct rgb **free;      /* buffers available to the producers */
+    int nb_free;
+    struct stream_band *queue;  /* bands waiting to be written */
+    int nb_queued;
+    int next_row;           /* first row not written yet */
+    int closing;
+    int ret;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static void *stream_writer(void *arg)
+{
+    struct img_stream *stream = arg;
+    struct stream_band band;
+    int i;
+
+    pthread_mutex_lock(&stream->lock);
+    for (;;) {
+        for (i = 0; i < stream->nb_queued; i++) {
+            if (stream->queue[i].start == stream->next_row)
+                break;
+        }
+        if (i == stream->nb_queued) {
+            if (stream->closing)
+                break;
+            pthread_cond_wait(&stream->cond, &stream->lock);
+            continue;
+        }
+        band = stream->queue[i];
+        stream->queue[i] = stream->queue[--stream->nb_queued];
+        pthread_mutex_unlock(&stream->lock);
+
+        size_t count = (size_t) (band.end - band.start) * stream->width;
+        int ret = fwrite(band.buffer, sizeof(struct rgb), count, stream->file) == count ? 0 : -1;
+
+        pthread_mutex_lock(&stream->lock);
+        if (ret < 0)
+            stream->ret = -1;
+        stream->next_row = band.end;
+        stream->free[stream->nb_free++] = band.buffer;
+        pthread_cond_broadcast(&stream->cond);
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return NULL;
+}
+
+/*
+ * Open `path` for an image of width x height, with `nb_buffers` band
+ * buffers (at least 2, to overlap one render with one write).
+ */
+struct img_stream *img_stream_open(const char *path, int width, int height, int nb_buffers)
+{
+    struct img_stream *stream;
+    int i;
+
+    if ((stream = calloc(1, sizeof(struct img_stream))) == NULL)
+        return NULL;
+    if (nb_buffers < 2)
+        nb_buffers = 2;
+    stream->width = width;
+    stream->height = height;
+    stream->nb_buffers = nb_buffers;
+    stream->rows = STREAM_BAND_BYTES / (sizeof(struct rgb) * width);
+    if (stream->rows < 1)
+        stream->rows = 1;
+    if (stream->rows > height)
+        stream->rows = height;
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->cond, NULL);
+
+    stream->buffers = calloc(nb_buffers, sizeof(struct rgb *));
+    stream->free = calloc(nb_buffers, sizeof(struct rgb *));
+    stream->queue = calloc(nb_buffers, sizeof(struct stream_band));
+    if (stream->buffers == NULL || stream->free == NULL || stream->queue == NULL)
+        goto err;
+    for (i = 0; i < nb_buffers; i++) {
+        stream->buffers[i] = malloc(sizeof(struct rgb) * width * stream->rows);
+        if (stream->buffers[i] == NULL)
+            goto err;
+        stream->free[stream->nb_free++] = stream->buffers[i];
+    }
+
+    if ((stream->file = fopen(path, "wb")) == NULL) {
+        perror(path);
+        goto err;
+    }
+    fprintf(stream->file, "P6\n%d %d\n%d\n", width, height, 255);
+
+    if (pthread_create(&stream->writer, NULL, stream_writer, stream) != 0) {
+        printf("pthread create error\n");
+        goto err;
+    }
+    return stream;
+err:
+    if (stream->file != NULL)
+        fclose(stream->file);
+    for (i = 0; stream->buffers != NULL && i < nb_buffers; i++)
+        FREE(stream->buffers[i]);
+    FREE(stream->buffers);
+    FREE(stream->free);
+    FREE(stream->queue);
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->cond);
+    FREE(stream);
+    return NULL;
+}
+
+/* image rows held by a buffer */
+int img_stream_rows(struct img_stream *stream)
+{
+    return stream->rows;
+}
+
+/* wait for a free buffer */
+struct rgb *img_stream_buffer(struct img_stream *stream)
+{
+    struct rgb *buffer;
+
+    pthread_mutex_lock(&stream->lock);
+    while (stream->nb_free == 0)
+        pthread_cond_wait(&stream->cond, &stream->lock);
+    buffer = stream->free[--stream->nb_free];
+    pthread_mutex_unlock(&stream->lock);
+    return buffer;
+}
+
+/* hand the rows [start, end[ held by `buffer` over to the writer */
+void img_stream_write(struct img_stream *stream, struct rgb *buffer, int start, int end)
+{
+    pthread_mutex_lock(&stream->lock);
+    stream->queue[stream->nb_queued].buffer = buffer;
+    stream->queue[stream->nb_queued].start = start;
+    stream->queue[stream->nb_queued].end = end;
+    stream->nb_queued++;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+/* give back a buffer that was not written */
+void img_stream_release(struct img_stream *stream, struct rgb *buffer)
+{
+    pthread_mutex_lock(&stream->lock);
+    stream->free[stream->nb_free++] = buffer;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+struct render_data {
+    struct img_stream *stream;
+    char *dragon;
+    int dragon_width;
+    int dragon_height;
+    struct palette *palette;
+    int nb_bands;
+    uint64_t next;          /* head of the work queue */
+};
+
+static void *render_worker(void *arg)
+{
+    struct render_data *data = arg;
+    struct img_stream *stream = data->stream;
+    struct rgb *buffer;
+    uint64_t i;
+
+    for (;;) {
+        buffer = img_stream_buffer(stream);
+        i = __sync_fetch_and_add(&data->next, 1);
+        if (i >= (uint64_t) data->nb_bands) {
+            img_stream_release(stream, buffer);
+            break;
+        }
+        int start = i * stream->rows;
+        int end = start + stream->rows;
+        if (end > stream->height)
+            end = stream->height;
+        scale_dragon_band(start, end, buffer, stream->width, stream->height,
+                data->dragon, 0, data->dragon_width, data->dragon_height, data->palette);
+        img_stream_write(stream, buffer, start, end);
+    }
+    return NULL;
+}
+
+/* render the whole canvas `dragon` to the stream */
+int img_stream_render(struct img_stream *stream, char *dragon, int dragon_width, int dragon_height,
+        struct palette *palette, int nb_thread)
+{
+    struct render_data data;
+    pthread_t *threads = NULL;
+    int i, ret = 0;
+
+    memset(&data, 0, sizeof(struct render_data));
+    data.stream = stream;
+    data.dragon = dragon;
+    data.dragon_width = dragon_width;
+    data.dragon_height = dragon_height;
+    data.palette = palette;
+    data.nb_bands = (stream->height + stream->rows - 1) / stream->rows;
+
+    if ((threads = calloc(nb_thread, sizeof(pthread_t))) == NULL)
+        return -1;
+    for (i = 0; i < nb_thread; i++) {
+        if (pthread_create(&threads[i], NULL, render_worker, &data) != 0) {
+            printf("pthread create error\n");
+            ret = -1;
+            break;
+        }
+    }
+    while (--i >= 0)
+        pthread_join(threads[i], NULL);
+    FREE(threads);
+    return ret;
+}
+
+/*
+ * Write the remaining bands and close the file. Fails if a write failed
+ * or if rows are missing.
+ */
+int img_stream_close(struct img_stream *stream)
+{
+    int i, ret;
+
+    pthread_mutex_lock(&stream->lock);
+    stream->closing = 1;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->writer, NULL);
+
+    ret = stream->ret;
+    if (stream->next_row != stream->height) {
+        printf("error: image stream stopped at row %d of %d\n", stream->next_row, stream->height);
+        ret = -1;
+    }
+    if (fclose(stream->file) != 0)
+        ret = -1;
+    for (i = 0; i < stream->nb_buffers; i++)
+        FREE(stream->buffers[i]);
+    FREE(stream->buffers);
+    FREE(stream->free);
+    FREE(stream->queue);
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->cond);
+    FREE(stream);
+    return ret;
+}
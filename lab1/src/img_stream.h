@@ -0,0 +1,27 @@
+/*
+ * img_stream.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef IMG_STREAM_H_
+#define IMG_STREAM_H_
+
+#include "dragon.h"
+#include "color.h"
+
+/* bytes of image per band of rows */
+#define STREAM_BAND_BYTES (1 << 22)
+
+struct img_stream;
+
+struct img_stream *img_stream_open(const char *path, int width, int height, int nb_buffers);
+int img_stream_rows(struct img_stream *stream);
+struct rgb *img_stream_buffer(struct img_stream *stream);
+void img_stream_write(struct img_stream *stream, struct rgb *buffer, int start, int end);
+void img_stream_release(struct img_stream *stream, struct rgb *buffer);
+int img_stream_render(struct img_stream *stream, char *dragon, int dragon_width, int dragon_height,
+        struct palette *palette, int nb_thread);
+int img_stream_close(struct img_stream *stream);
+
+#endif /* IMG_STREAM_H_ */
@@ -1,3 +1,24 @@
 #!/bin/sh
+set -e
 ${abs_top_srcdir}/src/dragonizer --cmd check --power 22 --thread 10
+${abs_top_srcdir}/src/dragonizer --cmd check --power 22 --thread 10 --deterministic
 
+# the other draw paths write the image of the serial draw
+dragonizer="${abs_top_srcdir}/src/dragonizer --thread 4"
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+$dragonizer --cmd draw --power 20 -o $out/serial.ppm
+$dragonizer --cmd draw --power 20 --mmap -o $out/mmap.ppm
+cmp $out/serial.ppm $out/mmap.ppm
+$dragonizer --cmd draw --power 20 --progressive 4 -o $out/progressive.ppm
+cmp $out/serial.ppm $out/progressive.ppm
+$dragonizer --cmd draw --power 20 --rle -o $out/rle.ppm
+cmp $out/serial.ppm $out/rle.ppm
+echo "1048576 512 512 $out/batch.ppm" > $out/jobs.txt
+$dragonizer --cmd batch --jobs $out/jobs.txt
+cmp $out/serial.ppm $out/batch.ppm
+
+# the video on the standard output is the one of the file, without the messages
+$dragonizer --cmd animate --power 8 --max 12 --format rgb -o $out/anim.rgb
+$dragonizer --cmd animate --power 8 --max 12 --format rgb -o - -v 2>/dev/null > $out/stdout.rgb
+cmp $out/anim.rgb $out/stdout.rgb
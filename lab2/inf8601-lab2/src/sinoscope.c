@@ -27,6 +27,8 @@
 #include "sinoscope_openmp.h"
 #include "sinoscope_opencl.h"
 #include "sinoscope_serial.h"
+#include "sinoscope_separable.h"
+#include "sinoscope_simd.h"
 #include "color.h"
 #include "memory.h"
 #include "util.h"
@@ -66,6 +68,8 @@ enum thread_lib {
 	LIB_SERIAL,
 	LIB_OPENMP,
 	LIB_OPENCL,
+	LIB_SEPARABLE,
+	LIB_SIMD,
 };
 
 struct command_opts {
@@ -94,6 +98,8 @@ static const struct lib_def libs[] = {
 		{ .name = "serial", .type = LIB_SERIAL, .handler = sinoscope_image_serial },
 		{ .name = "openmp", .type = LIB_OPENMP, .handler = sinoscope_image_openmp },
 		{ .name = "opencl", .type = LIB_OPENCL, .handler = sinoscope_image_opencl },
+		{ .name = "separable", .type = LIB_SEPARABLE, .handler = sinoscope_image_separable },
+		{ .name = "simd", .type = LIB_SIMD, .handler = sinoscope_image_simd },
 };
 
 typedef int (*cmd_handler)(struct command_opts*);
@@ -110,9 +116,9 @@ static void usage(void)
 	fprintf(stderr, "Usage: " PROGNAME " [OPTIONS] [COMMAND]\n");
 	fprintf(stderr, "\nOptions:\n");
 	fprintf(stderr, "  --help	this help\n");
-	fprintf(stderr, "  --cmd		command [ gui | benchmark | image ]\n");
+	fprintf(stderr, "  --cmd		command [ gui | benchmark | image | check ]\n");
 	fprintf(stderr, "  --lib		set the threading library to use "\
-			"[ serial | openmp | opencl ]\n");
+			"[ serial | openmp | opencl | separable | simd ]\n");
 	fprintf(stderr, "  --output set image path output\n");
 	fprintf(stderr, "  --height	set height\n");
 	fprintf(stderr, "  --width	set width\n");
@@ -131,6 +137,8 @@ static int init_lib(struct command_opts *opts)
 	switch (opts->lib->type) {
 	case LIB_SERIAL:
 	case LIB_OPENMP:
+	case LIB_SEPARABLE:
+	case LIB_SIMD:
 		break;
 	case LIB_OPENCL:
 		ret = opencl_init(opts->width, opts->height);
@@ -151,6 +159,8 @@ static int close_lib(struct command_opts *opts)
 	switch (opts->lib->type) {
 	case LIB_SERIAL:
 	case LIB_OPENMP:
+	case LIB_SEPARABLE:
+	case LIB_SIMD:
 		break;
 	case LIB_OPENCL:
 		opencl_shutdown();
@@ -282,6 +292,18 @@ static int cmd_benchmark(struct command_opts *opts)
 	run_benchmark(&stats, b, sinoscope_image_openmp, opts->iter);
 	write_stats(f, &stats);
 
+	/* separable, per row and per column sums, 8 threads */
+	b->name = "separable";
+	write_stats_info(f, b->name, opts->width, opts->height, opts->iter);
+	run_benchmark(&stats, b, sinoscope_image_separable, opts->iter);
+	write_stats(f, &stats);
+
+	/* simd, vector sin, cos and atan of the widest set, 8 threads */
+	b->name = "simd";
+	write_stats_info(f, b->name, opts->width, opts->height, opts->iter);
+	run_benchmark(&stats, b, sinoscope_image_simd, opts->iter);
+	write_stats(f, &stats);
+
 	/* opencl */
 	b->name = "opencl";
 	ret = opencl_init(opts->width, opts->height);
@@ -328,12 +350,83 @@ error:
 	goto done;
 }
 
+/*
+ * Compare the frames of the library with the ones of sinoscope_image_serial.
+ * The engines round the sums differently, so a pixel near a step of the
+ * value may take the neighbouring color: a byte passes if it is within one
+ * unit of the value, 255 / interval, and a frame if at most
+ * CHECK_MAX_RATIO of its bytes differ. Measured up to taylor 10001 down
+ * to 128x128, the worst frame is 0.008 % for separable and 0.48 % for simd
+ * with AVX. At 64x64 and taylor 10001 the sine arguments of simd pass 1e7,
+ * out of the range of its kernel, and a byte differs by 11.
+ */
+#define CHECK_FRAMES 4
+#define CHECK_TIME_STEP 1.7
+#define CHECK_MAX_RATIO 0.01
+
+static int cmd_check(struct command_opts *opts)
+{
+	int ret, f, i;
+	int max_diff, nb_diff, worst, errors = 0;
+	sinoscope_t *ref = NULL;
+	sinoscope_t *s = NULL;
+
+	ret = init_lib(opts);
+	ERR_THROW(0, ret, "init_lib error");
+
+	ref = make_sinoscope(opts->width, opts->height, opts->taylor, amp);
+	ERR_NOMEM(ref);
+	s = make_sinoscope(opts->width, opts->height, opts->taylor, amp);
+	ERR_NOMEM(s);
+	max_diff = (int) ceilf(255 * s->interval_inv);
+
+	for (f = 0; f < CHECK_FRAMES; f++) {
+		ref->time = s->time = f * CHECK_TIME_STEP;
+		sinoscope_corners(ref);
+		sinoscope_corners(s);
+		ret = sinoscope_image_serial(ref);
+		ERR_THROW(0, ret, "serial returned error");
+		ret = opts->lib->handler(s);
+		ERR_THROW(0, ret, "handler returned error");
+
+		nb_diff = worst = 0;
+		for (i = 0; i < s->buf_size; i++) {
+			int diff = abs(ref->buf[i] - s->buf[i]);
+			if (diff > 0)
+				nb_diff++;
+			if (diff > worst)
+				worst = diff;
+		}
+		if (worst <= max_diff && nb_diff <= s->buf_size * CHECK_MAX_RATIO) {
+			printf("PASS %s frame %d, %d of %d bytes differ by at most %d\n",
+					opts->lib->name, f, nb_diff, s->buf_size, worst);
+		} else {
+			printf("FAIL %s frame %d, %d of %d bytes differ by at most %d, "
+					"expected %d bytes by at most %d\n", opts->lib->name, f,
+					nb_diff, s->buf_size, worst,
+					(int) (s->buf_size * CHECK_MAX_RATIO), max_diff);
+			errors++;
+		}
+	}
+	ret = errors > 0 ? -1 : 0;
+done:
+	close_lib(opts);
+	free_sinoscope(ref);
+	free_sinoscope(s);
+	return ret;
+error:
+	ret = -1;
+	goto done;
+}
+
 static const struct command_def cmd_gui_def =
 { .name = "gui", .handler = cmd_gui };
 static const struct command_def cmd_benchmark_def =
 { .name = "benchmark", .handler = cmd_benchmark };
 static const struct command_def cmd_image_def =
 { .name = "image", .handler = cmd_image };
+static const struct command_def cmd_check_def =
+{ .name = "check", .handler = cmd_check };
 static const struct command_def cmd_def_last =
 { .name = NULL, .handler = NULL };
 
@@ -341,6 +434,7 @@ static const struct command_def * const commands[] = {
 		&cmd_gui_def,
 		&cmd_benchmark_def,
 		&cmd_image_def,
+		&cmd_check_def,
 		&cmd_def_last
 };
 
@@ -0,0 +1,158 @@
+/*
+ * sinoscope_simd.c
+ *
+ *  Created on: 2026-10-19
+ *
+ * Same sums as sinoscope_image_openmp, with the float sin, cos and atan
+ * approximations of sinoscope_simd_kernel.h evaluated on 16 pixels with
+ * AVX-512, 8 with AVX2 and FMA, or one at a time otherwise. The set is
+ * chosen once from the processor, and can be forced with the variable
+ * SINOSCOPE_SIMD=avx512|avx2|scalar. The columns are shared by OpenMP.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "sinoscope.h"
+#include "color.h"
+#include "memory.h"
+#include "sinoscope_simd.h"
+
+/* lanes of the widest set, for the padding of the buffers */
+#define SIMD_MAX_LANES 16
+
+#define SIMD_LANES 1
+#define SIMD_TARGET
+#define SIMD_SUFFIX scalar
+#include "sinoscope_simd_kernel.h"
+#undef SIMD_LANES
+#undef SIMD_TARGET
+#undef SIMD_SUFFIX
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_LANES 8
+#define SIMD_TARGET __attribute__((target("avx2,fma")))
+#define SIMD_SUFFIX avx2
+#include "sinoscope_simd_kernel.h"
+#undef SIMD_LANES
+#undef SIMD_TARGET
+#undef SIMD_SUFFIX
+
+#define SIMD_LANES 16
+#define SIMD_TARGET __attribute__((target("avx512f")))
+#define SIMD_SUFFIX avx512
+#include "sinoscope_simd_kernel.h"
+#undef SIMD_LANES
+#undef SIMD_TARGET
+#undef SIMD_SUFFIX
+#endif
+
+typedef void (*simd_column_fn)(const sinoscope_t *, int, const float *, const float *, int,
+        float *);
+
+struct simd_set {
+    const char *name;
+    simd_column_fn column;
+    int (*supported)(void);
+};
+
+static int simd_any(void)
+{
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static int simd_has_avx512(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+static int simd_has_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#endif
+
+/* widest first */
+static const struct simd_set simd_sets[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { .name = "avx512", .column = simd_column_avx512, .supported = simd_has_avx512 },
+    { .name = "avx2", .column = simd_column_avx2, .supported = simd_has_avx2 },
+#endif
+    { .name = "scalar", .column = simd_column_scalar, .supported = simd_any },
+    { .name = NULL },
+};
+
+static const struct simd_set *simd_set = NULL;
+
+/* the widest set of the processor, or the one of SINOSCOPE_SIMD */
+static const struct simd_set *simd_select(void)
+{
+    const char *force = getenv("SINOSCOPE_SIMD");
+    int i;
+
+    for (i = 0; simd_sets[i].name != NULL; i++) {
+        if (force != NULL && strcmp(force, simd_sets[i].name) != 0)
+            continue;
+        if (simd_sets[i].supported())
+            return &simd_sets[i];
+    }
+    if (force != NULL)
+        fprintf(stderr, "SINOSCOPE_SIMD=%s not supported, using the default\n", force);
+    for (i = 0; !simd_sets[i].supported(); i++);
+    return &simd_sets[i];
+}
+
+int sinoscope_image_simd(sinoscope_t *ptr)
+{
+    if (ptr == NULL)
+        return -1;
+
+    sinoscope_t sino = *ptr;
+    int nb_terms = sino.taylor > 0 ? (sino.taylor + 1) / 2 : 0;
+    int padded = nb_terms + SIMD_MAX_LANES;
+    float *px = NULL;
+    float *inv = NULL;
+    int x, y, k, ret = 0;
+
+    if (simd_set == NULL)
+        simd_set = simd_select();
+
+    /* px as sinoscope_image_serial computes it, and the lanes past the last y */
+    px = calloc(sino.height + SIMD_MAX_LANES, sizeof(float));
+    inv = calloc(padded, sizeof(float));
+    if (px == NULL || inv == NULL)
+        goto err;
+    for (y = 1; y < sino.height - 1; y++)
+        px[y] = sino.dx * y - 2 * M_PI;
+    for (k = 0; k < nb_terms; k++)
+        inv[k] = 1.0f / (2 * k + 1);
+
+    #pragma omp parallel private(x) shared(sino) reduction(|:ret)
+    {
+        float *ct = calloc(padded, sizeof(float));
+        if (ct == NULL)
+            ret = -1;
+
+        #pragma omp for
+        for (x = 1; x < sino.width - 1; x++) {
+            if (ct != NULL)
+                simd_set->column(&sino, x, px, inv, nb_terms, ct);
+        }
+        FREE(ct);
+    }
+
+done:
+    FREE(px);
+    FREE(inv);
+    return ret;
+err:
+    ret = -1;
+    goto done;
+}
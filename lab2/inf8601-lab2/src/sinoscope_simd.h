@@ -0,0 +1,14 @@
+/*
+ * sinoscope_simd.h
+ *
+ *  Created on: 2026-10-19
+ */
+
+#ifndef SINOSCOPE_SIMD_H_
+#define SINOSCOPE_SIMD_H_
+
+#include "sinoscope.h"
+
+int sinoscope_image_simd(sinoscope_t *b_ptr);
+
+#endif /* SINOSCOPE_SIMD_H_ */
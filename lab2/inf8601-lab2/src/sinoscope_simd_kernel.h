@@ -0,0 +1,167 @@
+/*
+ * sinoscope_simd_kernel.h
+ *
+ *  Created on: 2026-10-19
+ *
+ * Column kernel of sinoscope_simd.c, included once per instruction set
+ * with SIMD_LANES, SIMD_TARGET and SIMD_SUFFIX defined. The vectors are
+ * the vector extensions of GCC, which the target attribute compiles to
+ * the registers of the instruction set.
+ *
+ * The float approximations are those of Cephes: the argument of sin and
+ * cos is reduced to [-pi/4, pi/4] with pi/2 split in three parts, whose
+ * products by the quadrant are exact up to 2^13 quadrants, and atan is
+ * reduced to [0, tan(pi/8)]. The scalar set reduces in double instead,
+ * its products being rounded without FMA. Against the double functions
+ * of libm on the float arguments, on all the floats of the ranges:
+ *
+ *   sin, cos  |x| <= pi     1.5 ulp
+ *   sin, cos  |x| <= 100    5.8 ulp, near the zeros k * pi / 2
+ *   sin, cos  |x| <= 1e5    7.9e-8 absolute, the ulps growing near the zeros
+ *   atan      all floats    2.8 ulp
+ *
+ * The float sum of the pixel loses more than that, so the colours are
+ * those of sinoscope_image_serial but for a few pixels at a step.
+ */
+
+#define SIMD_CAT2(a, b) a##_##b
+#define SIMD_CAT(a, b) SIMD_CAT2(a, b)
+#define SIMD_FN(name) SIMD_CAT(name, SIMD_SUFFIX)
+
+#define vf SIMD_FN(vf)
+#define vi SIMD_FN(vi)
+
+typedef float vf __attribute__((vector_size(4 * SIMD_LANES)));
+typedef int32_t vi __attribute__((vector_size(4 * SIMD_LANES)));
+
+/* lanes of m from a, the others from b */
+#define SIMD_SELECT(m, a, b) ((vf) (((vi) (a) & (m)) | ((vi) (b) & ~(m))))
+#define SIMD_SIGN ((int32_t) 0x80000000)
+
+static inline SIMD_TARGET vf SIMD_FN(simd_load)(const float *p)
+{
+    vf v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline SIMD_TARGET void SIMD_FN(simd_store)(float *p, vf v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+/*
+ * |x| reduced to r in [-pi/4, pi/4], with the quadrant q of |x| = r + q * pi/2,
+ * and the polynomials of sin and cos of r
+ */
+static inline SIMD_TARGET void SIMD_FN(simd_sincos_poly)(vf x, vi *q, vf *s, vf *c)
+{
+    vf a = (vf) ((vi) x & ~SIMD_SIGN);
+#if SIMD_LANES == 1
+    /* without FMA the products by the quadrant are not exact, reduce in double */
+    double d = a[0];
+    int quadrant = d * M_2_PI + 0.5;
+    vi n = { quadrant };
+    vf r = { (float) (d - quadrant * M_PI_2) };
+#else
+    vi n = __builtin_convertvector(a * (float) M_2_PI + 0.5f, vi);
+    vf k = __builtin_convertvector(n, vf);
+    vf r = ((a - k * 1.5703125f) - k * 4.837512969970703125e-4f) - k * 7.54978995489188216e-8f;
+#endif
+    vf z = r * r;
+
+    *q = n & 3;
+    *s = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+    *c = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z
+            - 0.5f * z + 1.0f;
+}
+
+static inline SIMD_TARGET vf SIMD_FN(simd_sin)(vf x)
+{
+    vi q;
+    vf s, c;
+
+    SIMD_FN(simd_sincos_poly)(x, &q, &s, &c);
+    /* q: s, c, -s, -c, with the sign of x */
+    vf v = SIMD_SELECT((q & 1) != 0, c, s);
+    vi sign = (((q & 2) != 0) & SIMD_SIGN) ^ ((vi) x & SIMD_SIGN);
+    return (vf) ((vi) v ^ sign);
+}
+
+static inline SIMD_TARGET vf SIMD_FN(simd_cos)(vf x)
+{
+    vi q;
+    vf s, c;
+
+    SIMD_FN(simd_sincos_poly)(x, &q, &s, &c);
+    /* q: c, -s, -c, s */
+    vf v = SIMD_SELECT((q & 1) != 0, s, c);
+    vi sign = (((q + 1) & 2) != 0) & SIMD_SIGN;
+    return (vf) ((vi) v ^ sign);
+}
+
+static inline SIMD_TARGET vf SIMD_FN(simd_atan)(vf x)
+{
+    vf a = (vf) ((vi) x & ~SIMD_SIGN);
+    vi big = a > 2.414213562373095f;
+    vi mid = (a > 0.4142135623730950f) & ~big;
+    vf r = SIMD_SELECT(big, -1.0f / a, SIMD_SELECT(mid, (a - 1.0f) / (a + 1.0f), a));
+    vf y = SIMD_SELECT(big, (vf) {} + (float) M_PI_2, SIMD_SELECT(mid, (vf) {} + (float) M_PI_4, (vf) {}));
+    vf z = r * r;
+
+    y += (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z
+            - 3.33329491539e-1f) * z * r + r;
+    return (vf) ((vi) y ^ ((vi) x & SIMD_SIGN));
+}
+
+/*
+ * Pixels of column x, SIMD_LANES values of y at once. px holds the px of
+ * each y, inv the 1 / taylor of each term, and ct receives the cos terms
+ * of the column, which are the same for all its pixels.
+ */
+static SIMD_TARGET void SIMD_FN(simd_column)(const sinoscope_t *sino, int x, const float *px,
+        const float *inv, int nb_terms, float *ct)
+{
+    float py = sino->dy * x - 2 * M_PI;
+    vf iota;
+    int k, y, l, index;
+    struct rgb c;
+
+    for (l = 0; l < SIMD_LANES; l++)
+        iota[l] = l;
+
+    /* the cos terms, over the terms */
+    for (k = 0; k < nb_terms; k += SIMD_LANES) {
+        vf taylor = (iota + (float) k) * 2.0f + 1.0f;
+        vf v = SIMD_FN(simd_cos)(py * taylor * sino->phase0) * SIMD_FN(simd_load)(inv + k);
+        SIMD_FN(simd_store)(ct + k, v);
+    }
+
+    for (y = 1; y < sino->height - 1; y += SIMD_LANES) {
+        vf p = SIMD_FN(simd_load)(px + y);
+        vf val = (vf) {};
+        for (k = 0; k < nb_terms; k++) {
+            float taylor = 2 * k + 1;
+            val += SIMD_FN(simd_sin)(p * taylor * sino->phase1 + sino->time) * inv[k] + ct[k];
+        }
+        /* (atan(val) - atan(-val)) / pi */
+        val = SIMD_FN(simd_atan)(val) * (float) M_2_PI;
+        val = (val + 1) * 100;
+        for (l = 0; l < SIMD_LANES && y + l < sino->height - 1; l++) {
+            value_color(&c, val[l], sino->interval, sino->interval_inv);
+            index = ((y + l) * 3) + (x * 3) * sino->width;
+            sino->buf[index + 0] = c.r;
+            sino->buf[index + 1] = c.g;
+            sino->buf[index + 2] = c.b;
+        }
+    }
+}
+
+#undef vf
+#undef vi
+#undef SIMD_SELECT
+#undef SIMD_SIGN
+#undef SIMD_FN
+#undef SIMD_CAT
+#undef SIMD_CAT2
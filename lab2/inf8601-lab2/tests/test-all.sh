@@ -1,5 +1,11 @@
 #!/bin/sh
 
-${abs_top_srcdir}/encode/encode --cmd check
-RET=$?
-exit $RET
+${abs_top_srcdir}/encode/encode --cmd check || exit 1
+
+# the engines draw the frames of the serial engine, within the tolerance of cmd_check
+sinoscope=${abs_top_srcdir}/src/sinoscope
+$sinoscope --cmd check --lib separable || exit 1
+$sinoscope --cmd check --lib separable --taylor 1001 --width 128 --height 128 || exit 1
+$sinoscope --cmd check --lib simd || exit 1
+SINOSCOPE_SIMD=scalar $sinoscope --cmd check --lib simd --taylor 1001 --width 128 --height 128 || exit 1
+exit 0